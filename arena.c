@@ -0,0 +1,134 @@
+/*
+ * arena.c - Region allocation on top of the mm malloc package.
+ *
+ * Each chunk starts with a small header that links it into the arena's
+ * chunk list; the rest of the chunk is handed out by bumping a pointer.
+ * Requests larger than a quarter of a chunk get a chunk of their own,
+ * which is linked in behind the current chunk so that the space left
+ * in the current chunk is not wasted.
+ */
+#include <stdlib.h>
+
+#include "arena.h"
+#include "mm.h"
+
+#define ARENA_CHUNKSIZE 4096   /* default chunk size in bytes */
+#define ARENA_ALIGN     8      /* alignment of every object */
+
+/* rounds up to the nearest multiple of ARENA_ALIGN */
+#define ALIGN(size) (((size) + (ARENA_ALIGN-1)) & ~(size_t)(ARENA_ALIGN-1))
+
+/* The header at the start of each chunk */
+typedef struct chunk {
+    struct chunk *next;   /* next (older) chunk in the arena */
+    size_t pad;           /* keeps the payload ARENA_ALIGN aligned */
+} chunk_t;
+
+#define CHUNK_HDR ALIGN(sizeof(chunk_t))
+
+struct mm_arena {
+    chunk_t *chunks;      /* most recent chunk first */
+    char *cur;            /* next free byte in the current chunk */
+    char *end;            /* end of the current chunk */
+    size_t chunksize;     /* size of a regular chunk */
+};
+
+/* 
+ * new_chunk - Get a chunk with room for size bytes from mm_malloc and
+ *     link it in after the chunk "after" (or at the head if NULL)
+ */
+static chunk_t *new_chunk(mm_arena_t *arena, size_t size, chunk_t *after)
+{
+    chunk_t *c;
+
+    if ((c = (chunk_t *)mm_malloc(CHUNK_HDR + size)) == NULL)
+	return NULL;
+    if (after) {
+	c->next = after->next;
+	after->next = c;
+    }
+    else {
+	c->next = arena->chunks;
+	arena->chunks = c;
+    }
+    return c;
+}
+
+mm_arena_t *mm_arena_create(size_t chunksize)
+{
+    mm_arena_t *arena;
+
+    if ((arena = (mm_arena_t *)mm_malloc(sizeof(mm_arena_t))) == NULL)
+	return NULL;
+    arena->chunks = NULL;
+    arena->cur = arena->end = NULL;
+    arena->chunksize = chunksize ? ALIGN(chunksize) : ARENA_CHUNKSIZE;
+    return arena;
+}
+
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    char *p;
+    chunk_t *c;
+
+    size = ALIGN(size ? size : 1);
+
+    /* Fast path: bump the pointer in the current chunk */
+    if (size <= (size_t)(arena->end - arena->cur)) {
+	p = arena->cur;
+	arena->cur += size;
+	return p;
+    }
+
+    /* Big requests get a chunk of their own behind the current one */
+    if (size > arena->chunksize / 4 && arena->chunks) {
+	if ((c = new_chunk(arena, size, arena->chunks)) == NULL)
+	    return NULL;
+	return (char *)c + CHUNK_HDR;
+    }
+
+    /* Otherwise start a new current chunk */
+    if ((c = new_chunk(arena, size > arena->chunksize ? 
+		       size : arena->chunksize, NULL)) == NULL)
+	return NULL;
+    arena->cur = (char *)c + CHUNK_HDR;
+    arena->end = arena->cur + (size > arena->chunksize ? 
+			       size : arena->chunksize);
+    p = arena->cur;
+    arena->cur += size;
+    return p;
+}
+
+void mm_arena_reset(mm_arena_t *arena)
+{
+    chunk_t *c, *next, *first = NULL;
+
+    /* Give every chunk but the oldest back to the mm free lists */
+    for (c = arena->chunks; c != NULL; c = next) {
+	next = c->next;
+	if (next == NULL)
+	    first = c;
+	else
+	    mm_free(c);
+    }
+
+    /* Rewind the oldest one, which is always at least chunksize bytes */
+    arena->chunks = first;
+    arena->cur = arena->end = NULL;
+    if (first) {
+	first->next = NULL;
+	arena->cur = (char *)first + CHUNK_HDR;
+	arena->end = arena->cur + arena->chunksize;
+    }
+}
+
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    chunk_t *c, *next;
+
+    for (c = arena->chunks; c != NULL; c = next) {
+	next = c->next;
+	mm_free(c);
+    }
+    mm_free(arena);
+}
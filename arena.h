@@ -0,0 +1,36 @@
+/*
+ * arena.h - Region allocation on top of the mm malloc package.
+ *
+ * An arena bump-allocates objects inside chunks it obtains from
+ * mm_malloc. Objects are never freed one at a time: mm_arena_reset
+ * releases all of them at once, and mm_arena_destroy also releases the
+ * arena itself. This suits allocations that all die together, such as
+ * everything a request handler allocates for one request.
+ */
+#include <stddef.h>
+
+typedef struct mm_arena mm_arena_t;
+
+/* 
+ * mm_arena_create - Create an empty arena that grows in chunks of 
+ *     chunksize bytes (ARENA_CHUNKSIZE if 0). Returns NULL if the mm
+ *     heap is out of memory.
+ */
+mm_arena_t *mm_arena_create(size_t chunksize);
+
+/* 
+ * mm_arena_alloc - Allocate size bytes, aligned to 8 bytes, from the
+ *     arena. Returns NULL if a new chunk is needed and the mm heap is 
+ *     out of memory.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+
+/* 
+ * mm_arena_reset - Release every object in the arena. All chunks but
+ *     the first go back to the mm free lists, and the first is rewound
+ *     for reuse. The cost depends on the number of chunks, not objects.
+ */
+void mm_arena_reset(mm_arena_t *arena);
+
+/* mm_arena_destroy - Release every object and the arena itself */
+void mm_arena_destroy(mm_arena_t *arena);
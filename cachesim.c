@@ -0,0 +1,138 @@
+/*
+ * cachesim.c - A set-associative, write-allocate cache model with LRU
+ *     replacement, driven by the allocator's metadata accesses. 
+ *
+ * Running the allocator against the model instead of the host's caches
+ * makes the cost of a metadata layout deterministic: the same trace
+ * produces the same miss count on any machine.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cachesim.h"
+#include "memlib.h"
+
+/* One cache line: its tag, and when it was last used (for LRU) */
+typedef struct {
+    unsigned long tag;
+    unsigned long lru;
+    int valid;
+} line_t;
+
+static int num_sets = 0;          /* number of sets (0 if disabled) */
+static int num_ways = 0;          /* lines per set */
+static int line_bits = 0;         /* log2 of the line size */
+static line_t *lines = NULL;      /* num_sets * num_ways lines */
+static char *base = NULL;         /* addresses are relative to this */
+static unsigned long tick = 0;    /* advances on every access */
+static double accesses = 0;
+static double misses = 0;
+
+/* Return log2(n) if n is a power of two, -1 otherwise */
+static int log2_exact(long n)
+{
+    int bits = 0;
+
+    if (n <= 0 || (n & (n - 1)))
+	return -1;
+    while ((1L << bits) < n)
+	bits++;
+    return bits;
+}
+
+int cachesim_config(const char *spec)
+{
+    long sets, ways, line;
+
+    if (sscanf(spec, "%ld:%ld:%ld", &sets, &ways, &line) != 3 ||
+	log2_exact(sets) < 0 || log2_exact(ways) < 0 || 
+	log2_exact(line) < 0)
+	return -1;
+
+    free(lines);
+    if ((lines = (line_t *)calloc(sets * ways, sizeof(line_t))) == NULL)
+	return -1;
+    num_sets = sets;
+    num_ways = ways;
+    line_bits = log2_exact(line);
+    cachesim_reset();
+    return 0;
+}
+
+int cachesim_enabled(void)
+{
+    return num_sets > 0;
+}
+
+void cachesim_reset(void)
+{
+    if (lines)
+	memset(lines, 0, num_sets * num_ways * sizeof(line_t));
+    base = (char *)mem_heap_lo();
+    tick = 0;
+    accesses = 0;
+    misses = 0;
+}
+
+/* 
+ * touch - Look up the line holding p, filling it on a miss by evicting
+ *     the least recently used line of its set. Loads and stores are
+ *     treated alike, since the cache allocates on writes.
+ */
+static void touch(void *p)
+{
+    unsigned long block, tag;
+    int set, i;
+    line_t *s, *victim;
+
+    if (num_sets == 0)
+	return;
+
+    block = (unsigned long)((char *)p - base) >> line_bits;
+    set = block & (num_sets - 1);
+    tag = block / num_sets;
+    s = &lines[set * num_ways];
+    accesses++;
+    tick++;
+
+    for (i = 0; i < num_ways; i++) {
+	if (s[i].valid && s[i].tag == tag) {
+	    s[i].lru = tick;
+	    return;
+	}
+    }
+
+    /* Miss: fill an empty line, or else the least recently used one */
+    misses++;
+    victim = &s[0];
+    for (i = 0; i < num_ways && victim->valid; i++) {
+	if (!s[i].valid || s[i].lru < victim->lru)
+	    victim = &s[i];
+    }
+    victim->valid = 1;
+    victim->tag = tag;
+    victim->lru = tick;
+}
+
+void *cachesim_load(void *p)
+{
+    touch(p);
+    return p;
+}
+
+void *cachesim_store(void *p)
+{
+    touch(p);
+    return p;
+}
+
+double cachesim_accesses(void)
+{
+    return accesses;
+}
+
+double cachesim_misses(void)
+{
+    return misses;
+}
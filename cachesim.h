@@ -0,0 +1,37 @@
+/*
+ * cachesim.h - prototypes for the set-associative cache model in
+ *     cachesim.c, which counts the misses caused by the allocator's
+ *     metadata loads and stores
+ *
+ * mm.c feeds the model only when it is built with -DCACHESIM (see the
+ * Makefile), so the default build pays nothing for it.
+ */
+
+/* 
+ * cachesim_config - Configure the model from a "<sets>:<ways>:<line>"
+ *     spec, e.g. "64:8:64" for a 32 KB, 8-way cache with 64-byte lines.
+ *     All three must be powers of two. Returns 0 on success, -1 on a
+ *     bad spec. Configuring the model enables it.
+ */
+int cachesim_config(const char *spec);
+
+/* cachesim_enabled - Return nonzero if the model has been configured */
+int cachesim_enabled(void);
+
+/* 
+ * cachesim_reset - Empty the cache and zero the counters. Addresses are
+ *     taken relative to the heap base at the time of the reset, so the
+ *     results do not depend on where the host placed the heap.
+ */
+void cachesim_reset(void);
+
+/* 
+ * cachesim_load, cachesim_store - Record a metadata access to the word
+ *     at p and return p, so that they can wrap the GET/PUT macros
+ */
+void *cachesim_load(void *p);
+void *cachesim_store(void *p);
+
+/* cachesim_accesses, cachesim_misses - Counters since the last reset */
+double cachesim_accesses(void);
+double cachesim_misses(void);
@@ -45,6 +45,18 @@
  */
 #define AVG_LIBC_THRUPUT      600E3  /* 600 Kops/sec */
 
+/*
+ * AVG_LIBC_THRUPUT was measured on a 2002 reference machine, so on
+ * modern hardware the throughput cap saturates and stops telling
+ * packages apart. If CALIBRATE_LIBC is set, the driver instead
+ * measures libc malloc on the current machine over the same traces
+ * and normalizes against that. The measurement is cached per host in
+ * a file named LIBC_CACHE_PREFIX<hostname> in the current directory,
+ * and is redone whenever the set of traces changes (or with -r).
+ */
+#define CALIBRATE_LIBC        1
+#define LIBC_CACHE_PREFIX     ".libc-thruput."
+
  /* 
   * This constant determines the contributions of space utilization
   * (UTIL_WEIGHT) and throughput (1 - UTIL_WEIGHT) to the performance
@@ -58,9 +70,12 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. Traces with multi-GB live sets can be
+ * replayed by building with e.g. -DMAX_HEAP='(8LL<<30)'.
  */
+#ifndef MAX_HEAP
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
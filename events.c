@@ -0,0 +1,125 @@
+/*
+ * events.c - The per-thread rings of allocator operations (see
+ *     events.h).
+ *
+ * A thread gets its ring on the first operation it records, and the
+ * ring is pushed onto a global list with a compare-and-swap so that
+ * mm_events_dump can find it. The owning thread is the only writer:
+ * it fills the record at head and then publishes head with a release
+ * store. The dump reads head, copies the records below it, and reads
+ * head again to learn which of the copied records may have been
+ * overwritten in the meantime.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "events.h"
+
+unsigned int mm_events_size = 0;
+__thread mm_event_ring_t *mm_event_ring;  /* the calling thread's ring */
+
+static mm_event_ring_t *rings = NULL;  /* every ring, newest first */
+static unsigned int num_rings = 0;     /* rings made so far */
+
+static int write_all(int fd, const void *buf, size_t len);
+
+int mm_events_enable(unsigned int n)
+{
+    if (n & (n - 1))
+	return -1;
+    mm_events_size = n;
+    return 0;
+}
+
+int mm_events_dump(int fd)
+{
+    mm_event_ring_t *r, *list = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    mm_events_hdr_t hdr;
+    mm_events_ring_t rhdr;
+    mm_event_t *copy;
+    unsigned long long base, first, h1, h2, cap, i;
+
+    hdr.magic = MM_EVENTS_MAGIC;
+    hdr.rings = 0;
+    for (r = list; r; r = r->next)
+	hdr.rings++;
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0)
+	return -1;
+
+    for (r = list; r; r = r->next) {
+	cap = (unsigned long long)r->mask + 1;
+	if ((copy = malloc(cap * sizeof(mm_event_t))) == NULL)
+	    return -1;
+
+	/* Copy the records below head, then drop those the writer may
+	   have reached while they were being copied: up to the one it
+	   may be writing now, unless the ring is the caller's own */
+	h1 = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	base = h1 > cap ? h1 - cap : 0;
+	for (i = base; i < h1; i++)
+	    copy[i - base] = r->ev[i & r->mask];
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	h2 = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	first = r == mm_event_ring ? base : (h2 >= cap ? h2 - cap + 1 : 0);
+	if (first < base)
+	    first = base;
+	if (first > h1)
+	    first = h1;
+
+	rhdr.thread = r->thread;
+	rhdr.count = (unsigned int)(h1 - first);
+	rhdr.total = h2;
+	if (write_all(fd, &rhdr, sizeof(rhdr)) < 0 ||
+	    write_all(fd, copy + (first - base),
+		      rhdr.count * sizeof(mm_event_t)) < 0) {
+	    free(copy);
+	    return -1;
+	}
+	free(copy);
+    }
+    return 0;
+}
+
+/*
+ * mm_event_first - Make the calling thread's ring, put it on the list,
+ *     and record in it. aligned_alloc takes only multiples of the
+ *     alignment, which a ring of one or two records is not.
+ */
+void mm_event_first(int op, size_t size, size_t block,
+		    unsigned int flags, unsigned int visited)
+{
+    mm_event_ring_t *r;
+    size_t bytes = sizeof(mm_event_ring_t) + mm_events_size * sizeof(mm_event_t);
+
+    if ((r = aligned_alloc(64, (bytes + 63) & ~(size_t)63)) == NULL)
+	return;
+    memset(r, 0, sizeof(mm_event_ring_t));
+    r->mask = mm_events_size - 1;
+    r->thread = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	;
+    mm_event_ring = r;
+    mm_event_record(op, size, block, flags, visited);
+}
+
+/*
+ * write_all - Write len bytes, retrying short writes. Returns -1 on
+ *     an error.
+ */
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) <= 0)
+	    return -1;
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * events.h - A per-thread ring of the allocator's most recent
+ *     operations, for finding out after a latency spike or an
+ *     out-of-memory what led up to it
+ *
+ * With mm_config "events=<n>", each thread that calls into mm.c keeps
+ * its last n operations (n a power of two) in a ring of 16-byte
+ * records. Only the owning thread writes its ring, so recording takes
+ * no lock. mm_events_dump writes every thread's ring to a file, which
+ * the mmevents tool decodes.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stddef.h>
+
+/* Operations */
+#define MM_EV_MALLOC  1
+#define MM_EV_FREE    2
+#define MM_EV_REALLOC 3
+#define MM_EV_MEMALIGN 4
+#define MM_EV_HINT    5   /* mm_malloc_hint */
+
+/* Flags: what the operation did besides handing out or taking a block */
+#define MM_EVF_SPLIT     0x01  /* split a free block */
+#define MM_EVF_COALESCE1 0x02  /* merged a freed block with the next */
+#define MM_EVF_COALESCE2 0x04  /* ... with the previous */
+#define MM_EVF_COALESCE3 0x08  /* ... with both */
+#define MM_EVF_GREW      0x10  /* grew the heap */
+#define MM_EVF_FAILED    0x20  /* returned NULL */
+
+/* One operation */
+typedef struct {
+    unsigned int seq;        /* the thread's operation count, from 1 */
+    unsigned int size;       /* the request, or the size of the freed block */
+    unsigned int block;      /* heap offset of the block returned or freed */
+    unsigned short visited;  /* free blocks looked at, saturating */
+    unsigned char op;        /* MM_EV_* */
+    unsigned char flags;     /* MM_EVF_* */
+} mm_event_t;
+
+/* Records in the ring of each thread that records from now on; 0 stops recording */
+extern unsigned int mm_events_size;
+
+/* One thread's ring. Only events.c and mm_event_record look inside. */
+typedef struct mm_event_ring {
+    struct mm_event_ring *next;  /* the ring of the thread before it */
+    unsigned int thread;         /* the order in which it was made */
+    unsigned int mask;           /* records in the ring, less one */
+    unsigned long long head;     /* records written so far */
+    mm_event_t ev[] __attribute__((aligned(64)));  /* no record straddles two lines */
+} mm_event_ring_t;
+
+/* The calling thread's ring, or NULL before its first record */
+extern __thread mm_event_ring_t *mm_event_ring;
+
+/*
+ * mm_events_enable - Set the ring size; n must be 0 or a power of two.
+ *     Threads that already have a ring keep it. Returns -1 on a bad n.
+ *     mm.c picks its malloc and free paths at mm_init and mm_config, so
+ *     call this before mm_init, or use mm_config("events=<n>").
+ */
+int mm_events_enable(unsigned int n);
+
+/* mm_event_first - Make the calling thread's ring and record in it */
+void mm_event_first(int op, size_t size, size_t block,
+		    unsigned int flags, unsigned int visited);
+
+/*
+ * mm_event_record - Append an operation to the calling thread's ring.
+ *     Inline, so that recording is a few stores in the caller and no
+ *     call once the thread has its ring.
+ */
+static inline void mm_event_record(int op, size_t size, size_t block,
+				   unsigned int flags, unsigned int visited)
+{
+    mm_event_ring_t *r = mm_event_ring;
+    mm_event_t *e;
+    unsigned long long h;
+
+    if (__builtin_expect(r == NULL, 0)) {
+	mm_event_first(op, size, block, flags, visited);
+	return;
+    }
+
+    h = r->head;
+    e = &r->ev[h & r->mask];
+    e->seq = (unsigned int)(h + 1);
+    e->size = (unsigned int)size;
+    e->block = (unsigned int)block;
+    e->visited = visited < 0xffff ? visited : 0xffff;
+    e->op = op;
+    e->flags = flags;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_events_dump - Write every thread's ring, oldest record first, to
+ *     the file fd. Safe to call while other threads are recording;
+ *     records they overwrite during the dump are left out. Returns 0,
+ *     or -1 if a write failed.
+ */
+int mm_events_dump(int fd);
+
+/* The dump: a header, then for each ring a ring header and its records */
+#define MM_EVENTS_MAGIC 0x76656d6d  /* "mmev" */
+
+typedef struct {
+    unsigned int magic;      /* MM_EVENTS_MAGIC */
+    unsigned int rings;      /* rings that follow */
+} mm_events_hdr_t;
+
+typedef struct {
+    unsigned int thread;     /* the order in which threads got their ring */
+    unsigned int count;      /* records that follow */
+    unsigned long long total; /* operations the thread recorded in all */
+} mm_events_ring_t;
+
+#endif /* EVENTS_H */
@@ -0,0 +1,139 @@
+/*
+ * gensizeclass.c - Generates sizeclass.h, the size classes of the
+ *     thread cache (see mm_malloc_fast in mm.h).
+ *
+ * The classes are declared here by their spacing: SMALL_STEP apart up
+ * to SMALL_MAX, then CLASSES_PER_DOUBLING between successive powers of
+ * two up to MAX_CLASS. The generated header has the class sizes, a
+ * direct-index table for requests up to LOOKUP_MAX, and the constants
+ * mm_size_class needs to compute the class of larger requests from
+ * the position of their highest bit. Every size is checked against
+ * both before the header is written.
+ *
+ * Run by make; the output is not kept under version control. The
+ * spacing may be overridden from the make command line, e.g.
+ * make SIZECLASSES="-DSMALL_MAX=256 -DLG_CLASSES_PER_DOUBLING=3".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef SMALL_STEP
+#define SMALL_STEP 16            /* spacing of the smallest classes */
+#endif
+#ifndef SMALL_MAX
+#define SMALL_MAX 128            /* largest class spaced SMALL_STEP apart */
+#endif
+#ifndef LG_CLASSES_PER_DOUBLING
+#define LG_CLASSES_PER_DOUBLING 2 /* log2 of the classes per power of two above it */
+#endif
+#ifndef LG_LOOKUP_MAX
+#define LG_LOOKUP_MAX 10         /* log2 of the largest request looked up in the table */
+#endif
+#ifndef LG_MAX_CLASS
+#define LG_MAX_CLASS 12          /* log2 of the largest class */
+#endif
+
+#define CLASSES_PER_DOUBLING (1 << LG_CLASSES_PER_DOUBLING)
+#define LOOKUP_MAX (1 << LG_LOOKUP_MAX)
+#define MAX_CLASS (1 << LG_MAX_CLASS)
+#define MAX_CLASSES 256
+
+static size_t sizes[MAX_CLASSES];
+static int num_classes;
+static int lookup[(LOOKUP_MAX >> 4) + 1];
+
+static int large_class(size_t size, int large_base);
+static void fail(char *msg, size_t size);
+
+int main(void)
+{
+    size_t size, step;
+    int large_base, c, i;
+
+    /* The classes, from their declared spacing */
+    if (SMALL_MAX / SMALL_STEP >= MAX_CLASSES)
+	fail("there are too many classes", SMALL_MAX);
+    for (size = SMALL_STEP; size <= SMALL_MAX; size += SMALL_STEP)
+	sizes[num_classes++] = size;
+    for (size = SMALL_MAX; size < MAX_CLASS; ) {
+	step = size / CLASSES_PER_DOUBLING;
+	for (i = 0; i < CLASSES_PER_DOUBLING; i++) {
+	    if (num_classes == MAX_CLASSES)
+		fail("there are too many classes", size);
+	    size += step;
+	    sizes[num_classes++] = size;
+	}
+    }
+
+    /* The first class above the lookup table */
+    for (large_base = 0; sizes[large_base] <= LOOKUP_MAX; large_base++)
+	;
+
+    /* The table, for requests rounded up to 16 bytes */
+    for (i = 0, c = 0; i <= LOOKUP_MAX >> 4; i++) {
+	while (sizes[c] < (size_t)i << 4)
+	    c++;
+	lookup[i] = c;
+    }
+
+    /* Every request must land in the smallest class that holds it */
+    for (size = 1, c = 0; size <= MAX_CLASS; size++) {
+	if (size > sizes[c])
+	    c++;
+	if (size <= LOOKUP_MAX && lookup[(size + 15) >> 4] != c)
+	    fail("the table gives the wrong class", size);
+	if (size > LOOKUP_MAX && large_class(size, large_base) != c)
+	    fail("the computed class of a large size is wrong", size);
+    }
+
+    printf("/*\n");
+    printf(" * sizeclass.h - Size classes of the thread cache.\n");
+    printf(" * Generated by gensizeclass; do not edit.\n");
+    printf(" */\n");
+    printf("#ifndef SIZECLASS_H\n");
+    printf("#define SIZECLASS_H\n\n");
+    printf("#define MM_NUM_CLASSES %d\n", num_classes);
+    printf("#define MM_MAX_CLASS %d\n", MAX_CLASS);
+    printf("#define MM_LOOKUP_MAX %d\n", LOOKUP_MAX);
+    printf("#define MM_LG_LOOKUP_MAX %d\n", LG_LOOKUP_MAX);
+    printf("#define MM_LG_CLASSES_PER_DOUBLING %d\n", LG_CLASSES_PER_DOUBLING);
+    printf("#define MM_LARGE_BASE %d\n\n", large_base);
+
+    printf("/* The payload size of each class */\n");
+    printf("static const unsigned short mm_class_size[MM_NUM_CLASSES] = {");
+    for (c = 0; c < num_classes; c++)
+	printf("%s%lu", c % 10 ? ", " : (c ? ",\n    " : "\n    "),
+	       (unsigned long)sizes[c]);
+    printf("\n};\n\n");
+
+    printf("/* The class of each request up to MM_LOOKUP_MAX, indexed by (size + 15) >> 4 */\n");
+    printf("static const unsigned char mm_class_lookup[(MM_LOOKUP_MAX >> 4) + 1] = {");
+    for (i = 0; i <= LOOKUP_MAX >> 4; i++)
+	printf("%s%d", i % 16 ? ", " : (i ? ",\n    " : "\n    "), lookup[i]);
+    printf("\n};\n\n");
+    printf("#endif /* SIZECLASS_H */\n");
+    exit(0);
+}
+
+/*
+ * large_class - The class of a request above LOOKUP_MAX, computed the
+ *     way mm_size_class does: from the power of two below size - 1 and
+ *     the LG_CLASSES_PER_DOUBLING bits under it
+ */
+static int large_class(size_t size, int large_base)
+{
+    size_t x = size - 1;
+    int k = 63 - __builtin_clzl(x);
+
+    return large_base + ((k - LG_LOOKUP_MAX) << LG_CLASSES_PER_DOUBLING) +
+	(int)((x >> (k - LG_CLASSES_PER_DOUBLING)) & (CLASSES_PER_DOUBLING - 1));
+}
+
+/*
+ * fail - Report an inconsistent table and give up
+ */
+static void fail(char *msg, size_t size)
+{
+    fprintf(stderr, "gensizeclass: %s (size %lu)\n", msg, (unsigned long)size);
+    exit(1);
+}
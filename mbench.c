@@ -0,0 +1,1176 @@
+/*
+ * mbench.c - Microbenchmarks for the mm malloc package and the 
+ *     allocators layered on top of it.
+ *
+ * Where mdriver replays whole traces, each benchmark here isolates one
+ * mechanism and compares it against the plain mm_malloc/mm_free path.
+ * Run "mbench -h" for the list of benchmarks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "config.h"
+#include "pool.h"
+#include "objcache.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define POOL_NOBJS  20000 /* objects live at the peak of the pool benchmark */
+#define POOL_ROUNDS 4     /* times the pool workload is repeated per run */
+#define CONN_BUFSIZE 256  /* size of the buffer in an objcache test object */
+#define L1_SETS 64        /* sets of the L1 cache assumed by the color report */
+#define L1_LINE 64        /* its line size */
+#define PERSIST_NKEYS 100000   /* entries in the persist benchmark's table */
+#define PERSIST_NBUCKETS 65536 /* its buckets, a power of two */
+#define PERSIST_KEYLEN 16      /* room for a key in an entry */
+
+#define SHARED_PAIRS 2         /* producer/consumer process pairs */
+#define SHARED_NOBJS 20000     /* objects each producer hands over */
+#define SHARED_OBJSIZE 65536   /* their size */
+#define SHARED_WINDOW 32       /* objects a producer may have in flight */
+#define STARTUP_NOBJS 50000    /* mallocs into a fresh heap per startup run */
+#define SWEEP_BATCH 16         /* blocks live at once in the size sweep */
+#define SWEEP_ROUNDS 20000     /* batches allocated and freed per sweep run */
+#define CLASSES_NSIZES 4096    /* requests in the size-class lookup benchmark */
+#define CLASSES_ROUNDS 256     /* times each lookup run goes over them */
+#define REALLOC_BYTES (64<<20) /* bytes the realloc benchmark copies per run */
+#define REALLOC_HOT (512<<10)  /* bytes of the working set touched between moves */
+#define REALLOC_HOTBLK 4096    /* size of each block of the working set */
+#define CHURN_NOPS 200000      /* mallocs and frees per run of the events and stats benchmarks */
+#define CHURN_LIVE 1024        /* blocks live at once in them */
+#define CHURN_TRIALS 5         /* times each option is timed, alternating, keeping the best */
+
+/* Persistent data refers to other heap data by offset from the heap start */
+#define HEAP_OFF(p) ((size_t)((char *)(p) - (char *)mem_heap_lo()))
+#define HEAP_PTR(off) ((void *)((char *)mem_heap_lo() + (off)))
+
+/****************************** 
+ * The key compound data types 
+ *****************************/
+
+/* A benchmark and its description for -h */
+typedef struct {
+    char *name;
+    void (*run)(void);
+    char *desc;
+} bench_t;
+
+/* Parameters of one run of the pool workload, timed by fsecs */
+typedef struct {
+    size_t size;     /* object size */
+    int use_pool;    /* use mm_pool_alloc/free instead of mm_malloc/free */
+    void **objs;     /* the live objects */
+    size_t heapsize; /* heap size at the end of the run */
+} pool_args_t;
+
+/* 
+ * The objects of the objcache benchmark: a connection-like struct
+ * whose initialization (clearing its buffer) costs more than its
+ * allocation. A destructed object is marked so misuse shows up.
+ */
+typedef struct conn {
+    struct conn *next;    /* list links, reset on construction */
+    struct conn *prev;
+    int state;            /* CONN_IDLE when constructed, CONN_DEAD after */
+    size_t len;           /* bytes used in buf */
+    char buf[CONN_BUFSIZE];
+} conn_t;
+
+#define CONN_IDLE 1
+#define CONN_DEAD 0
+
+/* Parameters of one run of the objcache workload, timed by fsecs */
+typedef struct {
+    int use_cache;   /* use mm_cache_alloc/free instead of mm_malloc/free */
+    void **objs;     /* the live objects */
+} objcache_args_t;
+
+/* The persist benchmark's hash table, reached through the mm root */
+typedef struct {
+    size_t nbuckets;
+    size_t nentries;
+    size_t buckets;  /* offset of the bucket array (entry offsets, 0 = none) */
+} ptable_t;
+
+typedef struct {
+    size_t next;     /* offset of the next entry in the bucket, or 0 */
+    long value;
+    char key[PERSIST_KEYLEN];
+} pentry_t;
+
+/* Parameters of one run of the shared heap workload, timed by fsecs */
+typedef struct {
+    int by_offset;   /* pass offsets into the shared heap instead of copies */
+} shared_args_t;
+
+/* Parameters of one run of the startup workload, timed by fsecs */
+typedef struct {
+    size_t minsize;  /* smallest request */
+    size_t maxsize;  /* largest request */
+    int free_every;  /* free every n-th block right away, 0 for never */
+    void **objs;     /* room for the blocks */
+} startup_args_t;
+
+/* Parameters of one run of the size sweep, timed by fsecs */
+typedef struct {
+    size_t size;     /* request size */
+    int fast;        /* use mm_malloc_fast/mm_free_fast */
+} sweep_args_t;
+
+/* Parameters of one run of the size-class lookup benchmark, timed by fsecs */
+typedef struct {
+    size_t *sizes;   /* the requests */
+    int method;      /* CLASS_TABLE, CLASS_SCAN or CLASS_SEARCH */
+} classes_args_t;
+
+/* Parameters of one run of the realloc benchmark, timed by fsecs */
+typedef struct {
+    size_t size;     /* bytes of the block that is moved */
+    int move;        /* move the block by growing it */
+    int touch;       /* read the working set after each move */
+} realloc_args_t;
+
+/* Parameters of one run of the events and stats benchmarks, timed by fsecs */
+typedef struct {
+    void **objs;     /* room for the live blocks */
+} churn_args_t;
+
+/* The ways of finding a size class that the lookup benchmark compares */
+#define CLASS_TABLE  0   /* mm_size_class: the generated table and the highest bit */
+#define CLASS_SCAN   1   /* a loop up mm_class_size */
+#define CLASS_SEARCH 2   /* a binary search of mm_class_size */
+
+/* Flow control of one producer/consumer pair, kept in the shared heap */
+typedef struct {
+    volatile long consumed;  /* objects the consumer has freed */
+} shared_pair_t;
+
+/********************
+ * Global variables
+ *******************/
+int verbose = 0;        /* global flag for verbose output (read by fsecs) */
+
+/********************* 
+ * Function prototypes 
+ *********************/
+
+static void bench_pool(void);
+static void pool_workload(void *ptr);
+static void bench_objcache(void);
+static void objcache_workload(void *ptr);
+static void conn_ctor(void *obj, void *arg);
+static void conn_dtor(void *obj, void *arg);
+static void bench_persist(void);
+static void persist_build(void *ptr);
+static void persist_restart(void *ptr);
+static void persist_restart_scan(void *ptr);
+static long persist_lookup(ptable_t *table, char *key);
+static size_t persist_hash(char *key);
+static void bench_shared(void);
+static void shared_workload(void *ptr);
+static void shared_producer(int fd, shared_pair_t *pair);
+static void shared_consumer(int fd, shared_pair_t *pair);
+static void read_full(int fd, void *buf, size_t n);
+static void bench_startup(void);
+static void startup_workload(void *ptr);
+static void bench_sweep(void);
+static void sweep_workload(void *ptr);
+static void bench_classes(void);
+static void classes_workload(void *ptr);
+static void bench_realloc(void);
+static void realloc_workload(void *ptr);
+static void bench_events(void);
+static void bench_stats(void);
+static void time_options(char *what, char *opts[2]);
+static void churn_workload(void *ptr);
+
+static void usage(void);
+static void app_error(char *msg);
+
+/* The benchmarks, in the order they run by default */
+static bench_t benches[] = {
+    {"pool", bench_pool, "mm_pool_alloc/free vs mm_malloc/free for 16/48/128-byte objects"},
+    {"objcache", bench_objcache, "mm_cache_alloc/free of constructed objects vs mm_malloc+init"},
+    {"persist", bench_persist, "restarting on a file-backed heap vs rebuilding it"},
+    {"shared", bench_shared, "passing offsets in a shared heap vs copying through pipes"},
+    {"startup", bench_startup, "mm_malloc throughput while a fresh heap fills up"},
+    {"sweep", bench_sweep, "inline thread-cache fast path vs mm_malloc/free by size"},
+    {"classes", bench_classes, "generated size-class lookup vs scanning and searching"},
+    {"realloc", bench_realloc, "copy loops of a moving mm_realloc, and the cache they cost"},
+    {"events", bench_events, "mm_malloc/free with the per-thread event ring off and on"},
+    {"stats", bench_stats, "mm_malloc/free with the shared statistics page off and on"},
+    {NULL, NULL, NULL}
+};
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int i, j;
+    char c;
+
+    while ((c = getopt(argc, argv, "hv")) != EOF) {
+	switch (c) {
+	case 'v': /* Print details of the timing package */
+	    verbose = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+
+    init_fsecs();
+    mem_init();
+
+    /* Run the benchmarks named on the command line, or else all of them */
+    if (optind == argc) {
+	for (j = 0; benches[j].name; j++) {
+	    benches[j].run();
+	    printf("\n");
+	}
+    }
+    for (i = optind; i < argc; i++) {
+	for (j = 0; benches[j].name; j++)
+	    if (!strcmp(argv[i], benches[j].name))
+		break;
+	if (!benches[j].name) {
+	    fprintf(stderr, "Unknown benchmark %s\n", argv[i]);
+	    usage();
+	    exit(1);
+	}
+	benches[j].run();
+	printf("\n");
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*****************************************************************
+ * pool - Fixed-size objects through a pool and through mm_malloc.
+ * Each round allocates POOL_NOBJS objects, frees every other one,
+ * allocates those again and then frees everything. Fails if a pool
+ * ends up with a bigger heap than mm_malloc for any size.
+ ****************************************************************/
+
+static void bench_pool(void)
+{
+    static size_t sizes[] = {16, 48, 128};
+    int i, bigger = 0;
+    double mm_secs, pool_secs, ops;
+    size_t mm_heap;
+    pool_args_t args;
+
+    if ((args.objs = malloc(POOL_NOBJS * sizeof(void *))) == NULL)
+	app_error("malloc failed in bench_pool");
+
+    ops = (double)POOL_ROUNDS * 3 * POOL_NOBJS;
+    printf("Pool vs mm_malloc (%d objects live, %.0f ops per run):\n",
+	   POOL_NOBJS, ops);
+    printf("%6s%10s%11s%9s%10s%11s\n", 
+	   "size", "mm Kops", "pool Kops", "speedup", "mm heap", "pool heap");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	args.size = sizes[i];
+	args.use_pool = 0;
+	mm_secs = fsecs(pool_workload, &args);
+	mm_heap = args.heapsize;
+	args.use_pool = 1;
+	pool_secs = fsecs(pool_workload, &args);
+	printf("%6lu%10.0f%11.0f%8.2fx%10lu%11lu\n", 
+	       (unsigned long)sizes[i],
+	       ops/1e3/mm_secs,
+	       ops/1e3/pool_secs,
+	       mm_secs/pool_secs,
+	       (unsigned long)mm_heap,
+	       (unsigned long)args.heapsize);
+	if (args.heapsize > mm_heap)
+	    bigger = 1;
+    }
+    free(args.objs);
+    if (bigger)
+	app_error("a pool used more heap than mm_malloc in bench_pool");
+}
+
+static void pool_workload(void *ptr)
+{
+    pool_args_t *args = (pool_args_t *)ptr;
+    mm_pool_t *pool = NULL;
+    void **objs = args->objs;
+    int i, round;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in pool_workload");
+    if (args->use_pool && (pool = mm_pool_create(args->size, 0)) == NULL)
+	app_error("mm_pool_create failed in pool_workload");
+
+    for (round = 0; round < POOL_ROUNDS; round++) {
+	for (i = 0; i < POOL_NOBJS; i++)
+	    objs[i] = pool ? mm_pool_alloc(pool) : mm_malloc(args->size);
+	for (i = 0; i < POOL_NOBJS; i += 2) {
+	    if (pool) 
+		mm_pool_free(pool, objs[i]);
+	    else
+		mm_free(objs[i]);
+	}
+	for (i = 0; i < POOL_NOBJS; i += 2)
+	    objs[i] = pool ? mm_pool_alloc(pool) : mm_malloc(args->size);
+	for (i = POOL_NOBJS - 1; i >= 0; i--) {
+	    if (objs[i] == NULL)
+		app_error("allocation failed in pool_workload");
+	    if (pool) 
+		mm_pool_free(pool, objs[i]);
+	    else
+		mm_free(objs[i]);
+	}
+    }
+    args->heapsize = mem_heapsize();
+}
+
+/*****************************************************************
+ * objcache - Constructed objects through an object cache and
+ * through mm_malloc followed by initialization (and teardown before
+ * mm_free). Runs the same rounds as the pool benchmark. Also reports
+ * over how many L1 sets slab coloring spreads the first objects of
+ * the cache's slabs; without coloring they would all share one set.
+ * Fails if the cache is not faster than mm_malloc+init.
+ ****************************************************************/
+
+static void bench_objcache(void)
+{
+    double mm_secs, cache_secs, ops;
+    objcache_args_t args;
+    mm_cache_t *cache;
+    char seen[L1_SETS];
+    void *p;
+    int i, nsets, nslabs;
+
+    if ((args.objs = malloc(POOL_NOBJS * sizeof(void *))) == NULL)
+	app_error("malloc failed in bench_objcache");
+
+    ops = (double)POOL_ROUNDS * 3 * POOL_NOBJS;
+    printf("Object cache vs mm_malloc+init (%lu-byte objects, %d live, %.0f ops per run):\n",
+	   (unsigned long)sizeof(conn_t), POOL_NOBJS, ops);
+    args.use_cache = 0;
+    mm_secs = fsecs(objcache_workload, &args);
+    args.use_cache = 1;
+    cache_secs = fsecs(objcache_workload, &args);
+    printf("%10s%13s%9s\n", "mm Kops", "cache Kops", "speedup");
+    printf("%10.0f%13.0f%8.2fx\n", 
+	   ops/1e3/mm_secs, ops/1e3/cache_secs, mm_secs/cache_secs);
+    if (cache_secs >= mm_secs)
+	app_error("the object cache was not faster than mm_malloc+init in bench_objcache");
+
+    /* Objects fill their 4K slabs in order, so a new page means a new slab */
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in bench_objcache");
+    if ((cache = mm_cache_create(sizeof(conn_t), 0, conn_ctor, conn_dtor, NULL)) == NULL)
+	app_error("mm_cache_create failed in bench_objcache");
+    memset(seen, 0, sizeof(seen));
+    nsets = nslabs = 0;
+    for (i = 0; i < POOL_NOBJS; i++) {
+	p = mm_cache_alloc(cache);
+	args.objs[i] = p;
+	if (i == 0 || (size_t)p / 4096 != (size_t)args.objs[i-1] / 4096) {
+	    nslabs++;
+	    if (!seen[((size_t)p / L1_LINE) % L1_SETS]++)
+		nsets++;
+	}
+    }
+    printf("First objects of %d slabs fall in %d of %d L1 sets\n", 
+	   nslabs, nsets, L1_SETS);
+    for (i = 0; i < POOL_NOBJS; i++)
+	mm_cache_free(cache, args.objs[i]);
+    mm_cache_destroy(cache);
+    free(args.objs);
+}
+
+static void objcache_workload(void *ptr)
+{
+    objcache_args_t *args = (objcache_args_t *)ptr;
+    mm_cache_t *cache = NULL;
+    void **objs = args->objs;
+    int i, round;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in objcache_workload");
+    if (args->use_cache && 
+	(cache = mm_cache_create(sizeof(conn_t), 0, conn_ctor, conn_dtor, NULL)) == NULL)
+	app_error("mm_cache_create failed in objcache_workload");
+
+    for (round = 0; round < POOL_ROUNDS; round++) {
+	for (i = 0; i < POOL_NOBJS; i++) {
+	    if (cache)
+		objs[i] = mm_cache_alloc(cache);
+	    else if ((objs[i] = mm_malloc(sizeof(conn_t))) != NULL)
+		conn_ctor(objs[i], NULL);
+	}
+	for (i = 0; i < POOL_NOBJS; i += 2) {
+	    if (cache) 
+		mm_cache_free(cache, objs[i]);
+	    else {
+		conn_dtor(objs[i], NULL);
+		mm_free(objs[i]);
+	    }
+	}
+	for (i = 0; i < POOL_NOBJS; i += 2) {
+	    if (cache)
+		objs[i] = mm_cache_alloc(cache);
+	    else if ((objs[i] = mm_malloc(sizeof(conn_t))) != NULL)
+		conn_ctor(objs[i], NULL);
+	}
+	for (i = POOL_NOBJS - 1; i >= 0; i--) {
+	    if (objs[i] == NULL || ((conn_t *)objs[i])->state != CONN_IDLE)
+		app_error("bad object in objcache_workload");
+	    if (cache) 
+		mm_cache_free(cache, objs[i]);
+	    else {
+		conn_dtor(objs[i], NULL);
+		mm_free(objs[i]);
+	    }
+	}
+    }
+    if (cache)
+	mm_cache_destroy(cache);
+}
+
+/* conn_ctor - Put a conn_t in its idle state */
+static void conn_ctor(void *obj, void *arg)
+{
+    conn_t *c = (conn_t *)obj;
+
+    c->next = c->prev = c;
+    c->state = CONN_IDLE;
+    c->len = 0;
+    memset(c->buf, 0, CONN_BUFSIZE);
+}
+
+/* conn_dtor - Tear a conn_t down */
+static void conn_dtor(void *obj, void *arg)
+{
+    conn_t *c = (conn_t *)obj;
+
+    c->next = c->prev = NULL;
+    c->state = CONN_DEAD;
+}
+
+/*****************************************************************
+ * persist - A hash table of PERSIST_NKEYS entries in a heap kept in
+ * a file. Rebuilding means starting an empty heap and inserting
+ * every entry again. Restarting means unmapping the file, mapping it
+ * back and calling mm_attach, after which one lookup must succeed.
+ * A placeholder mapping keeps the old address taken, so the heap
+ * comes back elsewhere the way it would in a new process. Faulting
+ * the pages back in is left to the first accesses, so restart+scan
+ * also looks up every key.
+ ****************************************************************/
+
+static char persist_path[] = "/tmp/mbench-heap.XXXXXX";
+
+static void bench_persist(void)
+{
+    double build_secs, restart_secs, scan_secs;
+    void *oldbase;
+    int fd;
+
+    /* Switch memlib to a heap file for this benchmark */
+    if ((fd = mkstemp(persist_path)) < 0)
+	app_error("mkstemp failed in bench_persist");
+    close(fd);
+    mem_deinit();
+    if (mem_init_file(persist_path) < 0)
+	app_error("mem_init_file failed in bench_persist");
+
+    build_secs = fsecs(persist_build, NULL);
+    oldbase = mem_heap_lo();
+    restart_secs = fsecs(persist_restart, NULL);
+    scan_secs = fsecs(persist_restart_scan, NULL);
+
+    printf("File-backed heap, %d entries, %lu-byte heap:\n", 
+	   PERSIST_NKEYS, (unsigned long)mem_heapsize());
+    printf("%12s%14s%16s\n", "rebuild ms", "restart ms", "restart+scan ms");
+    printf("%12.3f%14.3f%16.3f\n", 
+	   build_secs*1e3, restart_secs*1e3, scan_secs*1e3);
+    printf("Restart is %.0fx faster than rebuilding (heap moved: %s)\n",
+	   build_secs/restart_secs, (mem_heap_lo() != oldbase) ? "yes" : "no");
+
+    mem_deinit();
+    unlink(persist_path);
+    mem_init();
+}
+
+/* persist_build - Start an empty heap and fill the table */
+static void persist_build(void *ptr)
+{
+    ptable_t *table;
+    pentry_t *e;
+    size_t *buckets;
+    size_t h;
+    long i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in persist_build");
+    if ((table = mm_malloc(sizeof(ptable_t))) == NULL ||
+	(buckets = mm_calloc(PERSIST_NBUCKETS, sizeof(size_t))) == NULL)
+	app_error("mm_malloc failed in persist_build");
+    table->nbuckets = PERSIST_NBUCKETS;
+    table->nentries = 0;
+    table->buckets = HEAP_OFF(buckets);
+
+    for (i = 0; i < PERSIST_NKEYS; i++) {
+	if ((e = mm_malloc(sizeof(pentry_t))) == NULL)
+	    app_error("mm_malloc failed in persist_build");
+	snprintf(e->key, PERSIST_KEYLEN, "key%ld", i);
+	e->value = i;
+	h = persist_hash(e->key) & (table->nbuckets - 1);
+	e->next = buckets[h];
+	buckets[h] = HEAP_OFF(e);
+	table->nentries++;
+    }
+    mm_set_root(table);
+}
+
+/* persist_restart - Map the heap file again and get the table back */
+static void persist_restart(void *ptr)
+{
+    void *oldbase = mem_heap_lo();
+    void *placeholder;
+
+    mem_deinit();
+    placeholder = mmap(oldbase, mem_pagesize() + MAX_HEAP, PROT_NONE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_init_file(persist_path) < 0)
+	app_error("mem_init_file failed in persist_restart");
+    if (placeholder != MAP_FAILED)
+	munmap(placeholder, mem_pagesize() + MAX_HEAP);
+    if (mm_attach() < 0)
+	app_error("mm_attach failed in persist_restart");
+    if (persist_lookup(mm_get_root(), "key0") != 0)
+	app_error("lookup failed in persist_restart");
+}
+
+/* persist_restart_scan - Restart, then look up every key */
+static void persist_restart_scan(void *ptr)
+{
+    char key[PERSIST_KEYLEN];
+    ptable_t *table;
+    long i;
+
+    persist_restart(ptr);
+    table = mm_get_root();
+    if (table->nentries != PERSIST_NKEYS)
+	app_error("table lost entries in persist_restart_scan");
+    for (i = 0; i < PERSIST_NKEYS; i++) {
+	snprintf(key, PERSIST_KEYLEN, "key%ld", i);
+	if (persist_lookup(table, key) != i)
+	    app_error("lookup failed in persist_restart_scan");
+    }
+}
+
+/* persist_lookup - Return the value stored under key, or -1 */
+static long persist_lookup(ptable_t *table, char *key)
+{
+    size_t *buckets = HEAP_PTR(table->buckets);
+    size_t off = buckets[persist_hash(key) & (table->nbuckets - 1)];
+    pentry_t *e;
+
+    for (; off != 0; off = e->next) {
+	e = HEAP_PTR(off);
+	if (!strcmp(e->key, key))
+	    return e->value;
+    }
+    return -1;
+}
+
+/* persist_hash - The djb2 hash of a string */
+static size_t persist_hash(char *key)
+{
+    size_t h = 5381;
+
+    while (*key)
+	h = h * 33 + (unsigned char)*key++;
+    return h;
+}
+
+/*****************************************************************
+ * shared - SHARED_PAIRS producer processes each hand SHARED_NOBJS
+ * objects of SHARED_OBJSIZE bytes to a consumer process over a pipe.
+ * With offsets, the producer fills an object it mm_mallocs from a
+ * heap in shared memory and sends its offset; the consumer checks it
+ * and mm_frees it. With copies, the whole object goes through the
+ * pipe. All processes share one heap and one lock. With offsets, a
+ * producer waits once SHARED_WINDOW of its objects are in flight, 
+ * using a counter the consumer bumps in the shared heap.
+ ****************************************************************/
+
+static void bench_shared(void)
+{
+    char name[64];
+    double copy_secs, offset_secs, objs;
+    shared_args_t args;
+
+    /* Switch memlib to a heap in shared memory for this benchmark */
+    snprintf(name, sizeof(name), "/mbench-heap.%d", (int)getpid());
+    mem_deinit();
+    if (mem_init_shared(name) < 0)
+	app_error("mem_init_shared failed in bench_shared");
+    mem_reset_brk();
+    if (mm_init() < 0 || mm_share() < 0)
+	app_error("mm_init failed in bench_shared");
+
+    args.by_offset = 0;
+    copy_secs = fsecs(shared_workload, &args);
+    args.by_offset = 1;
+    offset_secs = fsecs(shared_workload, &args);
+
+    objs = (double)SHARED_PAIRS * SHARED_NOBJS;
+    printf("Shared heap, %d producer/consumer pairs, %d-byte objects:\n",
+	   SHARED_PAIRS, SHARED_OBJSIZE);
+    printf("%13s%15s%9s\n", "copy Kobj/s", "offset Kobj/s", "speedup");
+    printf("%13.0f%15.0f%8.2fx\n", 
+	   objs/1e3/copy_secs, objs/1e3/offset_secs, copy_secs/offset_secs);
+
+    mem_deinit();
+    shm_unlink(name);
+    mem_init();
+}
+
+static void shared_workload(void *ptr)
+{
+    shared_args_t *args = (shared_args_t *)ptr;
+    shared_pair_t *pairs[SHARED_PAIRS];
+    pid_t pids[2 * SHARED_PAIRS];
+    int i, status, fds[2];
+
+    for (i = 0; i < SHARED_PAIRS; i++) {
+	pairs[i] = NULL;
+	if (args->by_offset) {
+	    if ((pairs[i] = mm_malloc(sizeof(shared_pair_t))) == NULL)
+		app_error("mm_malloc failed in shared_workload");
+	    pairs[i]->consumed = 0;
+	}
+	if (pipe(fds) < 0)
+	    app_error("pipe failed in shared_workload");
+	if ((pids[2*i] = fork()) == 0) {
+	    close(fds[0]);
+	    shared_producer(fds[1], pairs[i]);
+	    _exit(0);
+	}
+	if ((pids[2*i+1] = fork()) == 0) {
+	    close(fds[1]);
+	    shared_consumer(fds[0], pairs[i]);
+	    _exit(0);
+	}
+	close(fds[0]);
+	close(fds[1]);
+    }
+    for (i = 0; i < 2 * SHARED_PAIRS; i++) {
+	if (pids[i] < 0 || waitpid(pids[i], &status, 0) < 0 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    app_error("a worker failed in shared_workload");
+    }
+    for (i = 0; i < SHARED_PAIRS; i++)
+	mm_free(pairs[i]);
+}
+
+/* 
+ * shared_producer - Fill objects and send them to fd, by offset if 
+ *     pair is set and by copy otherwise
+ */
+static void shared_producer(int fd, shared_pair_t *pair)
+{
+    int by_offset = (pair != NULL);
+    char *buf = NULL;
+    size_t off;
+    int i;
+
+    if (!by_offset && (buf = malloc(SHARED_OBJSIZE)) == NULL)
+	app_error("malloc failed in shared_producer");
+    for (i = 0; i < SHARED_NOBJS; i++) {
+	if (by_offset) {
+	    while (i - pair->consumed >= SHARED_WINDOW)
+		sched_yield();
+	    if ((buf = mm_malloc(SHARED_OBJSIZE)) == NULL)
+		app_error("mm_malloc failed in shared_producer");
+	}
+	memset(buf, (char)i, SHARED_OBJSIZE);
+	if (by_offset) {
+	    off = HEAP_OFF(buf);
+	    if (write(fd, &off, sizeof(off)) != sizeof(off))
+		app_error("write failed in shared_producer");
+	}
+	else if (write(fd, buf, SHARED_OBJSIZE) != SHARED_OBJSIZE)
+	    app_error("write failed in shared_producer");
+    }
+    if (!by_offset)
+	free(buf);
+    close(fd);
+}
+
+/* shared_consumer - Receive objects from fd, check them and free them */
+static void shared_consumer(int fd, shared_pair_t *pair)
+{
+    int by_offset = (pair != NULL);
+    char *buf = NULL;
+    size_t off;
+    int i;
+
+    if (!by_offset && (buf = malloc(SHARED_OBJSIZE)) == NULL)
+	app_error("malloc failed in shared_consumer");
+    for (i = 0; i < SHARED_NOBJS; i++) {
+	if (by_offset) {
+	    read_full(fd, &off, sizeof(off));
+	    buf = HEAP_PTR(off);
+	}
+	else
+	    read_full(fd, buf, SHARED_OBJSIZE);
+	if (buf[0] != (char)i || buf[SHARED_OBJSIZE-1] != (char)i)
+	    app_error("bad object in shared_consumer");
+	if (by_offset) {
+	    mm_free(buf);
+	    __sync_fetch_and_add(&pair->consumed, 1);
+	}
+    }
+    if (!by_offset)
+	free(buf);
+    close(fd);
+}
+
+/* read_full - Read exactly n bytes from fd */
+static void read_full(int fd, void *buf, size_t n)
+{
+    ssize_t rc;
+
+    while (n > 0) {
+	if ((rc = read(fd, buf, n)) <= 0)
+	    app_error("read failed in read_full");
+	buf = (char *)buf + rc;
+	n -= rc;
+    }
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*****************************************************************
+ * startup - The allocation-heavy start of a program: a fresh heap
+ * takes STARTUP_NOBJS mallocs, with few or no frees in between, so
+ * nearly every block comes from the top of the heap.
+ ****************************************************************/
+
+static void bench_startup(void)
+{
+    static startup_args_t runs[] = {
+	{64, 64, 0, NULL},
+	{16, 512, 0, NULL},
+	{16, 512, 8, NULL},
+    };
+    int i;
+    double secs;
+
+    printf("mm_malloc into a fresh heap (%d mallocs per run):\n", 
+	   STARTUP_NOBJS);
+    printf("%10s%8s%10s%11s\n", "sizes", "frees", "Kops", "heap");
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+	if ((runs[i].objs = malloc(STARTUP_NOBJS * sizeof(void *))) == NULL)
+	    app_error("malloc failed in bench_startup");
+	secs = fsecs(startup_workload, &runs[i]);
+	printf("%5lu-%-4lu%8s%10.0f%11lu\n", 
+	       (unsigned long)runs[i].minsize,
+	       (unsigned long)runs[i].maxsize,
+	       runs[i].free_every ? "1 in 8" : "none",
+	       STARTUP_NOBJS/1e3/secs,
+	       (unsigned long)mem_heapsize());
+	free(runs[i].objs);
+    }
+}
+
+static void startup_workload(void *ptr)
+{
+    startup_args_t *args = (startup_args_t *)ptr;
+    size_t range = args->maxsize - args->minsize + 1;
+    unsigned int seed = 1;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in startup_workload");
+
+    for (i = 0; i < STARTUP_NOBJS; i++) {
+	seed = seed * 1103515245 + 12345;
+	if ((args->objs[i] = mm_malloc(args->minsize + (seed >> 8) % range)) == NULL)
+	    app_error("mm_malloc failed in startup_workload");
+	if (args->free_every && i % args->free_every == 0)
+	    mm_free(args->objs[i]);
+    }
+}
+
+/*****************************************************************
+ * sweep - Small alloc/free pairs through the inline thread-cache
+ * fast path (mm_malloc_fast/mm_free_fast) and through the out-of-line
+ * mm_malloc/mm_free, over a sweep of request sizes. Each round
+ * allocates SWEEP_BATCH blocks and frees them again. Sizes above
+ * MM_MAX_CLASS show what the fast path costs when it always falls
+ * through.
+ ****************************************************************/
+
+static void bench_sweep(void)
+{
+    static size_t sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024, 4096, 8192};
+    int i;
+    double mm_secs, fast_secs, ops;
+    sweep_args_t args;
+
+    ops = 2.0 * SWEEP_BATCH * SWEEP_ROUNDS;
+    printf("Thread cache vs mm_malloc (%d live, %.0f ops per run):\n",
+	   SWEEP_BATCH, ops);
+    printf("%6s%10s%12s%9s%9s\n", 
+	   "size", "mm ns/op", "fast ns/op", "speedup", "cached");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	args.size = sizes[i];
+	args.fast = 0;
+	mm_secs = fsecs(sweep_workload, &args);
+	args.fast = 1;
+	fast_secs = fsecs(sweep_workload, &args);
+	printf("%6lu%10.1f%12.1f%8.2fx%9s\n", 
+	       (unsigned long)sizes[i],
+	       mm_secs/ops*1e9,
+	       fast_secs/ops*1e9,
+	       mm_secs/fast_secs,
+	       sizes[i] <= MM_MAX_CLASS ? "yes" : "no");
+    }
+}
+
+static void sweep_workload(void *ptr)
+{
+    sweep_args_t *args = (sweep_args_t *)ptr;
+    void *objs[SWEEP_BATCH];
+    int i, round;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in sweep_workload");
+
+    for (round = 0; round < SWEEP_ROUNDS; round++) {
+	if (args->fast) {
+	    for (i = 0; i < SWEEP_BATCH; i++)
+		objs[i] = mm_malloc_fast(args->size);
+	    for (i = 0; i < SWEEP_BATCH; i++)
+		mm_free_fast(objs[i]);
+	}
+	else {
+	    for (i = 0; i < SWEEP_BATCH; i++)
+		objs[i] = mm_malloc(args->size);
+	    for (i = 0; i < SWEEP_BATCH; i++)
+		mm_free(objs[i]);
+	}
+    }
+    mm_tcache_flush();
+}
+
+/*****************************************************************
+ * classes - The cost of mapping a request size to its thread-cache
+ * size class with mm_size_class, which indexes the table that
+ * gensizeclass generates and computes larger classes from the
+ * highest bit, against the same mapping done by scanning up the
+ * class sizes and by binary search. Run on small requests only, and
+ * on a mix spread evenly over each power of two up to MM_MAX_CLASS,
+ * where the branches of the other two stop being predictable.
+ ****************************************************************/
+
+/* Sink for the looked-up classes, so the lookups are not optimized away */
+static volatile size_t classes_sink;
+
+static void bench_classes(void)
+{
+    static char *names[] = {"table", "scan", "search"};
+    static size_t small[CLASSES_NSIZES], mixed[CLASSES_NSIZES];
+    unsigned int seed = 1;
+    int i, lg, method;
+    double secs[2], lookups;
+    classes_args_t args;
+
+    for (i = 0; i < CLASSES_NSIZES; i++) {
+	seed = seed * 1103515245 + 12345;
+	small[i] = 1 + (seed >> 8) % 256;
+	seed = seed * 1103515245 + 12345;
+	lg = 4 + (seed >> 8) % 9;  /* up to MM_MAX_CLASS = 2^12 */
+	seed = seed * 1103515245 + 12345;
+	mixed[i] = 1 + (seed >> 8) % ((size_t)1 << lg);
+    }
+
+    lookups = (double)CLASSES_NSIZES * CLASSES_ROUNDS;
+    printf("Size-class lookup (%d classes up to %d bytes, %.0f lookups per run):\n",
+	   MM_NUM_CLASSES, MM_MAX_CLASS, lookups);
+    printf("%8s%14s%14s\n", "method", "small ns/op", "mixed ns/op");
+    for (method = CLASS_TABLE; method <= CLASS_SEARCH; method++) {
+	args.method = method;
+	args.sizes = small;
+	secs[0] = fsecs(classes_workload, &args);
+	args.sizes = mixed;
+	secs[1] = fsecs(classes_workload, &args);
+	printf("%8s%14.2f%14.2f\n", names[method],
+	       secs[0]/lookups*1e9, secs[1]/lookups*1e9);
+    }
+}
+
+static void classes_workload(void *ptr)
+{
+    classes_args_t *args = (classes_args_t *)ptr;
+    size_t size, c, sum = 0;
+    int i, round, lo, hi, mid;
+
+    for (round = 0; round < CLASSES_ROUNDS; round++) {
+	for (i = 0; i < CLASSES_NSIZES; i++) {
+	    size = args->sizes[i];
+	    switch (args->method) {
+	    case CLASS_TABLE:
+		c = mm_size_class(size);
+		break;
+	    case CLASS_SCAN:
+		for (c = 0; mm_class_size[c] < size; c++)
+		    ;
+		break;
+	    default:
+		for (lo = 0, hi = MM_NUM_CLASSES - 1; lo < hi; ) {
+		    mid = (lo + hi) / 2;
+		    if (mm_class_size[mid] < size)
+			lo = mid + 1;
+		    else
+			hi = mid;
+		}
+		c = lo;
+		break;
+	    }
+	    sum += c;
+	}
+    }
+    classes_sink = sum;
+}
+
+/*****************************************************************
+ * realloc - Large blocks moved by mm_realloc under each of its copy
+ * loops (mm_config "copy="). Each move grows the block by a few bytes,
+ * which always moves it, and then shrinks it back in place. Reports
+ * the copy rate, and what the moves cost a workload that keeps
+ * REALLOC_HOT bytes of other blocks in the cache and reads them all
+ * after every move: the time per cache line of those reads, against
+ * the same reads with no moves in between.
+ ****************************************************************/
+
+/* The working-set reads of the realloc runs so far, and the seconds they took */
+static double realloc_secs, realloc_lines;
+
+/* Sink for the working-set reads, so they are not optimized away */
+static volatile long realloc_sink;
+
+static void bench_realloc(void)
+{
+    static size_t sizes[] = {64<<10, 256<<10, 1<<20, 4<<20};
+    static char *modes[] = {"libc", "vector", "stream", "auto"};
+    char opts[32];
+    int i, m;
+    double secs;
+    realloc_args_t args;
+
+    printf("mm_realloc moves (%d MB copied per run, %d KB working set):\n",
+	   REALLOC_BYTES >> 20, REALLOC_HOT >> 10);
+    printf("%8s%8s%10s%16s\n", "size", "copy", "GB/s", "ns/line");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	args.size = sizes[i];
+	args.move = 0;
+	args.touch = 1;
+	realloc_secs = realloc_lines = 0;
+	fsecs(realloc_workload, &args);
+	printf("%7luK%8s%10s%16.2f\n", (unsigned long)(sizes[i] >> 10),
+	       "none", "-", realloc_secs / realloc_lines * 1e9);
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+	    sprintf(opts, "copy=%s", modes[m]);
+	    mm_config(opts);
+	    args.move = 1;
+	    args.touch = 0;
+	    secs = fsecs(realloc_workload, &args);
+	    args.touch = 1;
+	    realloc_secs = realloc_lines = 0;
+	    fsecs(realloc_workload, &args);
+	    printf("%8s%8s%10.2f%16.2f\n", "", modes[m],
+		   REALLOC_BYTES / secs / 1e9, realloc_secs / realloc_lines * 1e9);
+	}
+    }
+    mm_config("copy=auto");
+}
+
+static void realloc_workload(void *ptr)
+{
+    realloc_args_t *args = (realloc_args_t *)ptr;
+    char *hot[REALLOC_HOT / REALLOC_HOTBLK];
+    char *bp;
+    struct timespec start, end;
+    long sum = 0;
+    int i, j, k, moves = REALLOC_BYTES / args->size;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in realloc_workload");
+
+    for (i = 0; i < REALLOC_HOT / REALLOC_HOTBLK; i++) {
+	if ((hot[i] = mm_malloc(REALLOC_HOTBLK)) == NULL)
+	    app_error("mm_malloc failed in realloc_workload");
+	memset(hot[i], i, REALLOC_HOTBLK);
+    }
+    if ((bp = mm_malloc(args->size)) == NULL)
+	app_error("mm_malloc failed in realloc_workload");
+    memset(bp, 1, args->size);
+
+    for (k = 0; k < moves; k++) {
+	if (args->move) {
+	    if ((bp = mm_realloc(bp, args->size + 64)) == NULL ||
+		(bp = mm_realloc(bp, args->size)) == NULL)
+		app_error("mm_realloc failed in realloc_workload");
+	}
+	if (args->touch) {
+	    clock_gettime(CLOCK_MONOTONIC, &start);
+	    for (i = 0; i < REALLOC_HOT / REALLOC_HOTBLK; i++)
+		for (j = 0; j < REALLOC_HOTBLK; j += 64)
+		    sum += hot[i][j];
+	    clock_gettime(CLOCK_MONOTONIC, &end);
+	    realloc_secs += (end.tv_sec - start.tv_sec) + 
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	    realloc_lines += REALLOC_HOT / 64;
+	}
+    }
+    realloc_sink = sum;
+}
+
+/*****************************************************************
+ * events - What recording each operation in the calling thread's
+ * event ring (mm_config "events=") costs mm_malloc and mm_free, on
+ * random small blocks replacing each other in a fixed live set. A
+ * thread's ring keeps the size it was made with, so one size is
+ * measured against recording nothing. The two are timed in turn, and
+ * the best of their times kept, so that a burst of noise on the
+ * machine does not pass for the cost.
+ ****************************************************************/
+
+static void bench_events(void)
+{
+    static char *opts[] = {"events=0", "events=4096"};
+
+    time_options("events recorded", opts);
+    mm_config("events=0");
+}
+
+/*****************************************************************
+ * stats - What keeping the shared statistics page (mm_config
+ * "stats=") up to date costs mm_malloc and mm_free, on the same
+ * workload as events. Every operation bumps its counters inside the
+ * page's seqlock, so this is the price of letting mmstat watch.
+ ****************************************************************/
+
+static void bench_stats(void)
+{
+    static char *opts[] = {"stats=", "stats=mbench"};
+
+    time_options("statistics published", opts);
+    mm_config("stats=");
+}
+
+/*
+ * time_options - Time churn_workload under the first option and the
+ *     second in turn, and print what the second costs
+ */
+static void time_options(char *what, char *opts[2])
+{
+    churn_args_t args;
+    double secs, best[2] = {0, 0};
+    int i, t;
+
+    if ((args.objs = malloc(CHURN_LIVE * sizeof(void *))) == NULL)
+	app_error("malloc failed in time_options");
+
+    printf("mm_malloc/free with %s (%d ops per run, %d live):\n",
+	   what, CHURN_NOPS, CHURN_LIVE);
+    printf("%14s%10s%10s\n", "option", "Kops", "cost");
+    for (t = 0; t < CHURN_TRIALS; t++)
+	for (i = 0; i < 2; i++) {
+	    if (mm_config(opts[i]) < 0)
+		app_error("mm_config failed in time_options");
+	    secs = fsecs(churn_workload, &args);
+	    if (t == 0 || secs < best[i])
+		best[i] = secs;
+	}
+    for (i = 0; i < 2; i++)
+	printf("%14s%10.0f%9.1f%%\n", opts[i], CHURN_NOPS/1e3/best[i],
+	       (best[i] - best[0]) / best[0] * 100);
+    free(args.objs);
+}
+
+static void churn_workload(void *ptr)
+{
+    churn_args_t *args = (churn_args_t *)ptr;
+    unsigned int seed = 1;
+    int i, k;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in churn_workload");
+
+    for (i = 0; i < CHURN_LIVE; i++)
+	if ((args->objs[i] = mm_malloc(16 + i % 240)) == NULL)
+	    app_error("mm_malloc failed in churn_workload");
+    for (i = 0; i < CHURN_NOPS / 2; i++) {
+	seed = seed * 1103515245 + 12345;
+	k = (seed >> 8) % CHURN_LIVE;
+	mm_free(args->objs[k]);
+	if ((args->objs[k] = mm_malloc(16 + (seed >> 16) % 240)) == NULL)
+	    app_error("mm_malloc failed in churn_workload");
+    }
+    for (i = 0; i < CHURN_LIVE; i++)
+	mm_free(args->objs[i]);
+}
+
+/* 
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg) 
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/* 
+ * usage - Explain the command line arguments
+ */
+static void usage(void) 
+{
+    int j;
+
+    fprintf(stderr, "Usage: mbench [-hv] [<benchmark> ...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-v         Print details of the timing package.\n");
+    fprintf(stderr, "Benchmarks (all of them if none are named)\n");
+    for (j = 0; benches[j].name; j++)
+	fprintf(stderr, "\t%-10s %s\n", benches[j].name, benches[j].desc);
+}
@@ -15,11 +15,16 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "cachesim.h"
+#include "mmtrace.h"
+#include "events.h"
+#include "arena.h"
 
 /**********************
  * Constants and macros
@@ -29,9 +34,11 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAXFIELDS      5 /* max numeric fields on a request line */
+#define EVENTS      4096 /* events each ring keeps for -E, unless -o events= says */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -46,16 +53,21 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    enum {ALLOC, FREE, REALLOC, 
+	  CALLOC, MEMALIGN, SIZED_FREE} type; /* type of request */
+    long long index;                  /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc/calloc/
+					 memalign request, or of sized free */
+    size_t align;                     /* alignment of memalign request */
+    int tid;                          /* issuing thread (0 if not recorded) */
+    long long timestamp;              /* time of request (0 if not recorded) */
 } traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
+    long long sugg_heapsize; /* suggested heap size (unused) */
+    long long num_ids;   /* number of alloc/realloc ids */
+    long long num_ops;   /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
@@ -81,8 +93,31 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
-
-    /* Note: secs and util are only defined if valid is true */
+    double live_integral; /* live bytes summed over the requests (0 for libc) */
+    double heap_integral; /* heap size summed over the requests (0 for libc) */
+    double accesses; /* modeled metadata accesses per op (only with -C) */
+    double misses;   /* modeled metadata cache misses per op (only with -C) */
+    double phases;   /* number of arena phases in the trace (only with -A) */
+    double arena_secs; /* secs needed to replay it through arenas (-A) ... */
+    int arena_valid; /* ... if the arena replay fit in the heap */
+    double compactions; /* mm_compact calls in the handle replay (-H) */
+    double util_before; /* avg live/heapsize just before them (-H) ... */
+    double util_after;  /* ... and just after them */
+    double long_lived;  /* fraction of blocks the oracle hints long-lived (-L) */
+    double hint_util;   /* space utilization with those hints (-L) */
+    double bin_lookups; /* mallocs that looked in the exact-size bins */
+    double bin_hits;    /* ... and found a block there */
+    double bin_promotions; /* sizes that got a bin */
+    double bin_demotions;  /* bins taken back from sizes that cooled */
+    double predicted;   /* mallocs whose lifetime mm_malloc predicted */
+    double predicted_long; /* ... and put in the long-lived region */
+    double lifetime_samples; /* sampled blocks whose lifetime was learned */
+    double lifetime_mispredicts; /* ... and that had been predicted wrongly */
+    double verify_secs;   /* secs needed to run the trace while verifying (-c) */
+    double verify_blocks; /* blocks checked after the ops that touched them (-c) */
+    double verify_walks;  /* full walks of the heap (-c) */
+
+    /* Note: secs, util and the integrals are only defined if valid is true */
 } stats_t; 
 
 /********************
@@ -106,30 +141,51 @@ static char *default_tracefiles[] = {
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+static int add_range(range_t **ranges, char *lo, size_t size, 
+		     int tracenum, long long opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int read_fields(char *line, long long *fields);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
+static void eval_libc(char **tracefiles, int num_tracefiles, stats_t *stats);
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static void *libc_memalign(size_t alignment, size_t size);
+static double calibrate_libc(char **tracefiles, int num_tracefiles, 
+			     stats_t *libc_stats, int recalibrate);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *live_integral, double *heap_integral);
 static void eval_mm_speed(void *ptr);
 
+/* Routines for replaying a trace through the mm arena API */
+static long long arena_replay(trace_t *trace);
+static void eval_mm_arena(void *ptr);
+
+/* Routine for replaying a trace through the mm handle API */
+static void handle_replay(trace_t *trace, long long interval, stats_t *stats);
+static void hint_replay(trace_t *trace, int percent, stats_t *stats);
+
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcachesim(int n, stats_t *stats, char *spec);
+static void printarena(int n, stats_t *stats);
+static void printcompact(int n, stats_t *stats, long long interval);
+static void printverify(int n, stats_t *stats, long long interval);
+static void printhints(int n, stats_t *stats, int percent);
+static void printbins(int n, stats_t *stats);
+static void printpredict(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, long long opnum, char *msg);
 static void app_error(char *msg);
 
 /**************
@@ -145,20 +201,35 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    mm_stats_t counters;       /* mm counters of the last utilization run */
+    double bin_lookups = 0;    /* exact-size bin lookups over all traces */
+    double predicted = 0;      /* lifetime predictions over all traces */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int recalibrate = 0; /* If set, ignore cached libc throughput (-r) */
+    char *cachespec = NULL; /* If set, model metadata cache misses (-C) */
+    int run_arena = 0;   /* If set, also replay traces through arenas (-A) */
+    long long compact_interval = 0; /* If set, replay through handles (-H) */
+    int hint_percent = 0; /* If set, replay with oracle lifetime hints (-L) */
+    long long verify_interval = 0; /* If set, also time replays that verify (-c) */
+    char *tracepoints = NULL; /* If set, count these mm tracepoints (-T) */
+    char *eventfile = NULL; /* If set, dump the mm event rings here (-E) */
+    unsigned int events = EVENTS; /* and how many events each ring keeps */
+    FILE *fp;
+    char verify_opts[MAXLINE];     /* the mm_config option that turns it on */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double libc_thruput; /* libc throughput that normalizes the index */
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalrc:C:AE:H:L:o:T:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +255,69 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'A': /* Compare individual frees against arena resets */
+            run_arena = 1;
+            break;
+        case 'E': /* Record mm events and dump the rings to a file */
+	    eventfile = optarg;
+            break;
+        case 'H': /* Replay through handles, compacting every n ops */
+	    if ((compact_interval = atoll(optarg)) <= 0) {
+		printf("ERROR: bad compaction interval \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'c': /* Time replays that verify the heap, walking it every n ops */
+	    if ((verify_interval = atoll(optarg)) <= 0) {
+		printf("ERROR: bad verification interval \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+	    sprintf(verify_opts, "verify=%lld", verify_interval);
+            break;
+        case 'L': /* Replay with lifetime hints taken from the trace */
+	    if ((hint_percent = atoi(optarg)) <= 0 || hint_percent > 100) {
+		printf("ERROR: bad lifetime percentage \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'o': /* Set mm allocator options */
+	    if (mm_config(optarg) < 0) {
+		printf("ERROR: bad mm options \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'r': /* Remeasure libc throughput even if it is cached */
+            recalibrate = 1;
+            break;
+        case 'C': /* Model the metadata cache misses of mm malloc */
+#ifndef CACHESIM
+	    printf("ERROR: -C needs a driver built with \"make CACHESIM=1\"\n");
+	    exit(1);
+#endif
+	    if (cachesim_config(optarg) < 0) {
+		printf("ERROR: bad cache spec \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+	    cachespec = optarg;
+            break;
+        case 'T': /* Count mm tracepoints and time find_fit */
+#ifndef MM_TRACEPOINTS
+	    printf("ERROR: -T needs a driver built with \"make TRACE=1\"\n");
+	    exit(1);
+#endif
+	    if (mm_trace_enable(optarg) < 0) {
+		printf("ERROR: bad tracepoints \"%s\"\n", optarg);
+		usage();
+		exit(1);
+	    }
+	    mm_trace_enable("");
+	    tracepoints = optarg;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -198,6 +332,11 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+
+    /* Record events only where -E wants them, in rings of the size -o chose */
+    if (mm_events_size)
+	events = mm_events_size;
+    mm_events_enable(0);
 	
     /* 
      * Check and print team info 
@@ -251,20 +390,7 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	eval_libc(tracefiles, num_tracefiles, libc_stats);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -297,12 +423,56 @@ int main(int argc, char **argv)
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    if (cachespec)
+		cachesim_reset();
+	    if (tracepoints)
+		mm_trace_enable(tracepoints);
+	    if (eventfile)
+		mm_events_enable(events);
+	    mm_stats[i].util = eval_mm_util(trace, i, &ranges,
+					    &mm_stats[i].live_integral,
+					    &mm_stats[i].heap_integral);
+	    if (tracepoints)
+		mm_trace_enable("");
+	    mm_events_enable(0);
+	    mm_get_stats(&counters);
+	    mm_stats[i].bin_lookups = counters.bin_hits + counters.bin_misses;
+	    mm_stats[i].bin_hits = counters.bin_hits;
+	    mm_stats[i].bin_promotions = counters.bin_promotions;
+	    mm_stats[i].bin_demotions = counters.bin_demotions;
+	    bin_lookups += mm_stats[i].bin_lookups;
+	    mm_stats[i].predicted = counters.predicted;
+	    mm_stats[i].predicted_long = counters.predicted_long;
+	    mm_stats[i].lifetime_samples = counters.lifetime_samples;
+	    mm_stats[i].lifetime_mispredicts = counters.lifetime_mispredicts;
+	    predicted += mm_stats[i].predicted;
+	    if (cachespec) {
+		mm_stats[i].accesses = cachesim_accesses() / trace->num_ops;
+		mm_stats[i].misses = cachesim_misses() / trace->num_ops;
+	    }
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (verify_interval) {
+		mm_config(verify_opts);
+		mm_stats[i].verify_secs = fsecs(eval_mm_speed, &speed_params);
+		mm_get_stats(&counters);
+		mm_stats[i].verify_blocks = counters.verify_blocks;
+		mm_stats[i].verify_walks = counters.verify_walks;
+		mm_config("verify=0");
+	    }
+	    if (run_arena) {
+		mm_stats[i].phases = arena_replay(trace);
+		mm_stats[i].arena_valid = (mm_stats[i].phases >= 0);
+		if (mm_stats[i].arena_valid)
+		    mm_stats[i].arena_secs = fsecs(eval_mm_arena, &speed_params);
+	    }
+	    if (compact_interval)
+		handle_replay(trace, compact_interval, &mm_stats[i]);
+	    if (hint_percent)
+		hint_replay(trace, hint_percent, &mm_stats[i]);
 	}
 	free_trace(trace);
     }
@@ -314,12 +484,72 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Likewise for the arena comparison of -A */
+    if (run_arena) {
+	printarena(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Likewise for the oracle lifetime hints of -L */
+    if (hint_percent) {
+	printhints(num_tracefiles, mm_stats, hint_percent);
+	printf("\n");
+    }
+
+    /* Likewise for the lifetime predictor of -o predict=size|site */
+    if (predicted > 0) {
+	printpredict(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Likewise for the exact-size bins of -o bins=<n> */
+    if (bin_lookups > 0) {
+	printbins(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Likewise for the tracepoints of -T, over the utilization replays */
+    if (tracepoints) {
+	mm_trace_enable(tracepoints);
+	printf("Tracepoints (utilization replays of all traces):\n");
+	mm_trace_print(stdout);
+	printf("\n");
+    }
+
+    /* Dump the event rings of -E, which end with the last utilization replay */
+    if (eventfile) {
+	if ((fp = fopen(eventfile, "w")) == NULL || mm_events_dump(fileno(fp)) < 0)
+	    unix_error("ERROR: could not dump the mm events");
+	fclose(fp);
+	printf("Events of the utilization replays dumped to %s (see mmevents).\n\n",
+	       eventfile);
+    }
+
+    /* Likewise for the verification overhead of -c */
+    if (verify_interval) {
+	printverify(num_tracefiles, mm_stats, verify_interval);
+	printf("\n");
+    }
+
+    /* Likewise for the compaction results of -H */
+    if (compact_interval) {
+	printcompact(num_tracefiles, mm_stats, compact_interval);
+	printf("\n");
+    }
+
+    /* The modeled cache misses are the point of -C, so always show them */
+    if (cachespec) {
+	printcachesim(num_tracefiles, mm_stats, cachespec);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
     secs = 0;
     ops = 0;
     util = 0;
+    avg_mm_throughput = 0;
     numcorrect = 0;
     for (i=0; i < num_tracefiles; i++) {
 	secs += mm_stats[i].secs;
@@ -330,6 +560,15 @@ int main(int argc, char **argv)
     }
     avg_mm_util = util/num_tracefiles;
 
+    /*
+     * Determine the libc throughput that normalizes the index, either
+     * measured on this machine or the fixed reference value
+     */
+    libc_thruput = AVG_LIBC_THRUPUT;
+    if (CALIBRATE_LIBC)
+	libc_thruput = calibrate_libc(tracefiles, num_tracefiles, 
+				      libc_stats, recalibrate);
+
     /* 
      * Compute and print the performance index 
      */
@@ -337,15 +576,19 @@ int main(int argc, char **argv)
 	avg_mm_throughput = ops/secs;
 
 	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+	if (avg_mm_throughput > libc_thruput) {
 	    p2 = (double)(1.0 - UTIL_WEIGHT);
 	} 
 	else {
 	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+		(avg_mm_throughput/libc_thruput);
 	}
 	
 	perfindex = (p1 + p2)*100.0;
+	printf("Relative speed = %.2fx libc (%.0f Kops vs %.0f Kops)\n",
+	       avg_mm_throughput/libc_thruput,
+	       avg_mm_throughput/1e3,
+	       libc_thruput/1e3);
 	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
 	       p1*100, 
 	       p2*100, 
@@ -360,6 +603,8 @@ int main(int argc, char **argv)
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
+	if (errors == 0)
+	    printf("relspeed:%.2f\n", avg_mm_throughput/libc_thruput);
     }
 
     exit(0);
@@ -378,8 +623,8 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+static int add_range(range_t **ranges, char *lo, size_t size, 
+		     int tracenum, long long opnum)
 {
     char *hi = lo + size - 1;
     range_t *p;
@@ -475,11 +720,15 @@ static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
+    traceop_t *op;
+    char line[MAXLINE];
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    long long fields[MAXFIELDS];
+    int nfields, nargs, n;
+    long long index;
+    long long max_index = 0;
+    long long op_index;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -495,9 +744,9 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
+    fscanf(tracefile, "%lld", &(trace->sugg_heapsize)); /* not used */
+    fscanf(tracefile, "%lld", &(trace->num_ids));     
+    fscanf(tracefile, "%lld", &(trace->num_ops));     
     fscanf(tracefile, "%d", &(trace->weight));        /* not used */
     
     /* We'll store each request line in the trace in this array */
@@ -515,37 +764,77 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
     
-    /* read every request line in the trace file */
+    /* 
+     * Read every request line in the trace file. Each line is a type
+     * character followed by its arguments, optionally followed by the
+     * id of the issuing thread and a timestamp.
+     */
     index = 0;
     op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
+    while (fgets(line, MAXLINE, tracefile) != NULL) {
+	if (sscanf(line, "%s%n", type, &n) != 1)
+	    continue; /* ignore blank lines */
+	if (op_index >= trace->num_ops) {
+	    printf("More than %lld requests in tracefile %s\n", 
+		   trace->num_ops, path);
+	    exit(1);
+	}
+	op = &trace->ops[op_index];
+	memset(op, 0, sizeof(traceop_t));
+	nfields = read_fields(line + n, fields);
+
 	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
+	case 'a': /* a <id> <bytes> */
+	    op->type = ALLOC;
+	    nargs = 2;
 	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
+	case 'r': /* r <id> <bytes> */
+	    op->type = REALLOC;
+	    nargs = 2;
 	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
+	case 'f': /* f <id> */
+	    op->type = FREE;
+	    nargs = 1;
+	    break;
+	case 'c': /* c <id> <bytes> */
+	    op->type = CALLOC;
+	    nargs = 2;
+	    break;
+	case 'm': /* m <id> <alignment> <bytes> */
+	    op->type = MEMALIGN;
+	    nargs = 3;
+	    break;
+	case 'F': /* F <id> <bytes> */
+	    op->type = SIZED_FREE;
+	    nargs = 2;
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
 	    exit(1);
 	}
+	if (nfields < nargs) {
+	    printf("Missing arguments to %c request on line %lld of %s\n",
+		   type[0], LINENUM(op_index), path);
+	    exit(1);
+	}
+
+	index = fields[0];
+	op->index = index;
+	if (op->type == MEMALIGN) {
+	    op->align = fields[1];
+	    op->size = fields[2];
+	}
+	else if (nargs > 1)
+	    op->size = fields[1];
+	if (nfields > nargs)
+	    op->tid = fields[nargs];
+	if (nfields > nargs + 1)
+	    op->timestamp = fields[nargs + 1];
+
+	if (op->type != FREE && op->type != SIZED_FREE)
+	    max_index = (index > max_index) ? index : max_index;
 	op_index++;
-	
     }
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
@@ -554,6 +843,25 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * read_fields - parse up to MAXFIELDS whitespace-separated integers
+ *     from a request line and return how many were found
+ */
+static int read_fields(char *line, long long *fields)
+{
+    int n = 0;
+    char *end;
+
+    while (n < MAXFIELDS) {
+	fields[n] = strtoll(line, &end, 10);
+	if (end == line)
+	    break;
+	line = end;
+	n++;
+    }
+    return n;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
  *              to, all of which were allocated in read_trace().
@@ -576,10 +884,12 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
-    int index;
-    int size;
-    int oldsize;
+    long long i;
+    size_t j;
+    long long index;
+    size_t size;
+    size_t oldsize;
+    size_t align;
     char *newp;
     char *oldp;
     char *p;
@@ -602,9 +912,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+
+	    /* Call the student's malloc, calloc or memalign */
+	    if (trace->ops[i].type == CALLOC) 
+		p = mm_calloc(1, size);
+	    else if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -616,6 +934,27 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
 		return 0;
+
+	    /* A calloc'ed block must be zero-filled ... */
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero "
+				     "the block");
+			return 0;
+		    }
+		}
+	    }
+
+	    /* ... and a memalign'ed one must honor the alignment */
+	    align = trace->ops[i].align;
+	    if (trace->ops[i].type == MEMALIGN && align > 0 && 
+		((size_t)p % align) != 0) {
+		sprintf(msg, "Payload address (%p) not aligned to %lu bytes", 
+			p, (unsigned long)align);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
@@ -674,6 +1013,22 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+        case SIZED_FREE: /* mm_free_sized */
+
+	    /* The trace must pass the size the block was last given,
+	       since the other replays trust it */
+	    if (size != trace->block_sizes[index]) {
+		sprintf(msg, "Sized free of %lu bytes for a block of %lu",
+			(unsigned long)size,
+			(unsigned long)trace->block_sizes[index]);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    mm_free_sized(p, size);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -689,19 +1044,29 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest the heap got while running the student's malloc package
+ *   on the trace. mem_sbrk() lets the brk pointer come down (mm.c's
+ *   "trim" option does), so it is sampled after every request rather
+ *   than read at the end.
+ *
+ *   Peak utilization ignores how long the heap stays bloated, so we
+ *   also sum the live bytes and the heap size after every request into
+ *   *live_integral and *heap_integral. Their ratio is the time-weighted
+ *   utilization; its inverse is the committed heap per live byte, so it
+ *   gets no column of its own. Taking the ratio of the integrals, rather
+ *   than averaging heapsize/live over the requests, weights each request
+ *   by the bytes live after it, so the near-empty heap at the start and
+ *   end of a trace does not swamp the figure.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *live_integral, double *heap_integral)
 {   
-    int i;
-    int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    long long i;
+    long long index;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
+    size_t max_heap_size = 0;  /* the largest the heap got */
     char *p;
     char *newp, *oldp;
 
@@ -709,15 +1074,24 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     mem_reset_brk();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    *live_integral = *heap_integral = 0;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -756,11 +1130,15 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
+        case SIZED_FREE: /* mm_free_sized */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    if (trace->ops[i].type == SIZED_FREE)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -772,9 +1150,15 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* Sample the live bytes and the committed heap after this request */
+	*live_integral += total_size;
+	*heap_integral += mem_heapsize();
+	if (mem_heapsize() > max_heap_size)
+	    max_heap_size = mem_heapsize();
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)max_heap_size);
 }
 
 
@@ -784,7 +1168,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    long long i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -805,6 +1190,22 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -820,11 +1221,412 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case SIZED_FREE: /* mm_free_sized */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_sized(block, trace->ops[i].size);
+            break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/*
+ * arena_replay - Replay a trace through an mm arena instead of freeing
+ *    blocks one at a time. A phase of the trace ends whenever its live
+ *    set becomes empty. Every block of the phase is dead by then, so the
+ *    individual frees are dropped and the arena is reset instead.
+ *    Returns the number of phases, or -1 if the heap ran out of memory.
+ */
+static long long arena_replay(trace_t *trace)
+{
+    long long i, index;
+    long long live = 0;
+    long long phases = 0;
+    size_t size, oldsize, align;
+    char *p, *oldp;
+    mm_arena_t *arena;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in arena_replay");
+    if ((arena = mm_arena_create(0)) == NULL)
+	return -1;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_arena_alloc */
+        case CALLOC:
+        case MEMALIGN:
+	    align = trace->ops[i].align;
+	    if (trace->ops[i].type != MEMALIGN || align <= ALIGNMENT)
+		align = 0;
+	    if ((p = mm_arena_alloc(arena, size + align)) == NULL)
+		return -1;
+	    if (align)
+		p = (char *)(((size_t)p + align - 1) & ~(align - 1));
+	    if (trace->ops[i].type == CALLOC)
+		memset(p, 0, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    live++;
+	    break;
+
+        case REALLOC: /* mm_arena_alloc and copy */
+	    oldp = trace->blocks[index];
+	    oldsize = trace->block_sizes[index];
+	    if ((p = mm_arena_alloc(arena, size)) == NULL)
+		return -1;
+	    memcpy(p, oldp, (size < oldsize) ? size : oldsize);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* dropped, but may end the phase */
+        case SIZED_FREE:
+	    if (--live == 0) {
+		mm_arena_reset(arena);
+		phases++;
+	    }
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in arena_replay");
+	}
+    }
+
+    if (live > 0)
+	phases++;
+    mm_arena_destroy(arena);
+    return phases;
+}
+
+/*
+ * eval_mm_arena - This is the function that is used by fcyc() to
+ *    measure the running time of the arena replay
+ */
+static void eval_mm_arena(void *ptr)
+{
+    if (arena_replay(((speed_t *)ptr)->trace) < 0)
+	app_error("mm_arena_alloc failed in eval_mm_arena");
+}
+
+/*
+ * handle_replay - Replay a trace through the mm handle API, treating
+ *    each trace id as a handle, and call mm_compact every interval ops.
+ *    Each compaction that finds live blocks is a sample of the
+ *    utilization (live bytes over heap size) just before and just
+ *    after compacting. Memaligned blocks are not movable and take the
+ *    plain API. The first and last payload bytes of every block are
+ *    stamped with its id and checked when it is freed, so a bad move
+ *    is caught.
+ */
+static void handle_replay(trace_t *trace, long long interval, stats_t *stats)
+{
+    long long i, index;
+    size_t size, live = 0;
+    double before = 0, after = 0;
+    long long samples = 0;
+    mm_handle_t *handles;
+    char *p;
+
+    if ((handles = calloc(trace->num_ids, sizeof(mm_handle_t))) == NULL)
+	unix_error("calloc failed in handle_replay");
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in handle_replay");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_halloc */
+        case CALLOC: /* mm_halloc and clear */
+	    if ((handles[index] = mm_halloc(size)) == 0)
+		app_error("mm_halloc failed in handle_replay");
+	    p = mm_hlock(handles[index]);
+	    if (trace->ops[i].type == CALLOC)
+		memset(p, 0, size);
+	    break;
+
+        case MEMALIGN: /* mm_memalign, never moved */
+	    handles[index] = 0;
+	    if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign failed in handle_replay");
+	    trace->blocks[index] = p;
+	    break;
+
+        case REALLOC: /* mm_hrealloc, or mm_realloc if not movable */
+	    live -= trace->block_sizes[index];
+	    if (handles[index]) {
+		if (mm_hrealloc(handles[index], size) < 0)
+		    app_error("mm_hrealloc failed in handle_replay");
+		p = mm_hlock(handles[index]);
+	    }
+	    else if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in handle_replay");
+	    else
+		trace->blocks[index] = p;
+	    break;
+
+        case FREE: /* mm_hfree, or mm_free if not movable */
+        case SIZED_FREE:
+	    size = trace->block_sizes[index];
+	    live -= size;
+	    p = handles[index] ? mm_hlock(handles[index]) : trace->blocks[index];
+	    if (size > 0 && (p[0] != (char)index || p[size-1] != (char)index))
+		app_error("mm_compact corrupted a block in handle_replay");
+	    if (handles[index])
+		mm_hfree(handles[index]);
+	    else
+		mm_free(p);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in handle_replay");
+	}
+
+	/* Stamp new and resized blocks, and leave them unlocked */
+	if (trace->ops[i].type != FREE && trace->ops[i].type != SIZED_FREE) {
+	    trace->block_sizes[index] = size;
+	    live += size;
+	    if (size > 0)
+		p[0] = p[size-1] = (char)index;
+	    if (handles[index])
+		mm_hunlock(handles[index]);
+	}
+
+	if ((i + 1) % interval == 0 && live > 0) {
+	    before += (double)live / mem_heapsize();
+	    mm_compact();
+	    after += (double)live / mem_heapsize();
+	    samples++;
+	}
+    }
+
+    stats->compactions = samples;
+    stats->util_before = samples ? before / samples : 0;
+    stats->util_after = samples ? after / samples : 0;
+    free(handles);
+}
+
+/*
+ * hint_replay - Replay a trace with mm_malloc_hint, acting as an oracle
+ *    that knows every block's lifetime in advance. A block is hinted
+ *    long-lived if it lives for at least percent of the trace's requests
+ *    or is never freed. Reallocs keep the block's region, and memaligns
+ *    take the plain API. Records the fraction of blocks hinted
+ *    long-lived and the peak utilization of the replay.
+ */
+static void hint_replay(trace_t *trace, int percent, stats_t *stats)
+{
+    long long i, index;
+    long long *born, *died;
+    long long num_long = 0, num_blocks = 0;
+    size_t size, total_size = 0, max_total_size = 0;
+    int hint;
+    char *p;
+
+    born = calloc(trace->num_ids, sizeof(long long));
+    died = calloc(trace->num_ids, sizeof(long long));
+    if (born == NULL || died == NULL)
+	unix_error("calloc failed in hint_replay");
+
+    /* Find when each block is allocated and when it is freed */
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	died[index] = trace->num_ops;
+    }
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	if (trace->ops[i].type == FREE || trace->ops[i].type == SIZED_FREE)
+	    died[index] = i;
+	else if (trace->ops[i].type != REALLOC)
+	    born[index] = i;
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in hint_replay");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc_hint */
+        case CALLOC: /* mm_malloc_hint and clear */
+	    hint = ((died[index] - born[index]) * 100 >= 
+		    (long long)percent * trace->num_ops) ?
+		MM_LONG_LIVED : MM_SHORT_LIVED;
+	    num_long += (hint == MM_LONG_LIVED);
+	    num_blocks++;
+	    if ((p = mm_malloc_hint(size, hint)) == NULL)
+		app_error("mm_malloc_hint failed in hint_replay");
+	    if (trace->ops[i].type == CALLOC)
+		memset(p, 0, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+        case MEMALIGN: /* mm_memalign, never hinted */
+	    if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign failed in hint_replay");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+        case REALLOC: /* mm_realloc, which stays in the block's region */
+	    if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in hint_replay");
+	    total_size += size - trace->block_sizes[index];
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free */
+        case SIZED_FREE: /* mm_free_sized */
+	    size = trace->block_sizes[index];
+	    if (trace->ops[i].type == SIZED_FREE)
+		mm_free_sized(trace->blocks[index], size);
+	    else
+		mm_free(trace->blocks[index]);
+	    total_size -= size;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in hint_replay");
+	}
+
+	max_total_size = (total_size > max_total_size) ?
+	    total_size : max_total_size;
+    }
+
+    stats->long_lived = num_blocks ? (double)num_long / num_blocks : 0;
+    stats->hint_util = (double)max_total_size / (double)mem_heapsize();
+    free(born);
+    free(died);
+}
+
+/*
+ * eval_libc - Evaluate the libc malloc package on each tracefile,
+ *    filling in one stats_t struct per tracefile
+ */
+static void eval_libc(char **tracefiles, int num_tracefiles, stats_t *stats)
+{
+    int i;
+    trace_t *trace;
+    speed_t speed_params;
+
+    for (i=0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	stats[i].ops = trace->num_ops;
+	if (verbose > 1)
+	    printf("Checking libc malloc for correctness, ");
+	stats[i].valid = eval_libc_valid(trace, i);
+	if (stats[i].valid) {
+	    speed_params.trace = trace;
+	    if (verbose > 1)
+		printf("and performance.\n");
+	    stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+	}
+	free_trace(trace);
+    }
+}
+
+/*
+ * calibrate_libc - Return the throughput (ops/sec) of libc malloc on
+ *    this machine over the same tracefiles that mm malloc is scored on.
+ *    If libc_stats is non-NULL, libc was already evaluated (-l) and we
+ *    reuse those numbers. Otherwise we look for a cached measurement in
+ *    LIBC_CACHE_PREFIX<hostname>, keyed by a hash of the trace set and
+ *    of each trace file's size and modification time, and only run
+ *    libc if there is none or if recalibrate is set.
+ */
+static double calibrate_libc(char **tracefiles, int num_tracefiles, 
+			     stats_t *libc_stats, int recalibrate)
+{
+    int i;
+    char *s;
+    char host[MAXLINE];
+    char path[MAXLINE];
+    struct stat st;
+    unsigned long key = 5381;
+    unsigned long cached_key;
+    double thruput, secs = 0, ops = 0;
+    stats_t *stats = libc_stats;
+    FILE *fp;
+
+    /* Hash the trace set, so that -f and -t runs get their own entries */
+    for (s = tracedir; *s; s++)
+	key = key * 33 + *s;
+    for (i = 0; i < num_tracefiles; i++) {
+	for (s = tracefiles[i]; *s; s++)
+	    key = key * 33 + *s;
+
+	/* An edited trace, or another one by the same name, is a new set */
+	snprintf(path, MAXLINE, "%s%s", tracedir, tracefiles[i]);
+	if (stat(path, &st) == 0) {
+	    key = key * 33 + (unsigned long)st.st_size;
+	    key = key * 33 + (unsigned long)st.st_mtim.tv_sec;
+	    key = key * 33 + (unsigned long)st.st_mtim.tv_nsec;
+	}
+    }
+
+    if (gethostname(host, MAXLINE) < 0)
+	strcpy(host, "localhost");
+    host[MAXLINE-1] = '\0';
+    snprintf(path, MAXLINE, "%s%s", LIBC_CACHE_PREFIX, host);
+
+    /* Use the cached measurement for this host if it is still valid */
+    if (stats == NULL && !recalibrate && (fp = fopen(path, "r")) != NULL) {
+	i = fscanf(fp, "%lu %lf", &cached_key, &thruput);
+	fclose(fp);
+	if (i == 2 && cached_key == key && thruput > 0) {
+	    if (verbose > 1)
+		printf("Using cached libc throughput from %s\n", path);
+	    return thruput;
+	}
+    }
+
+    /* Otherwise measure libc malloc over the same traces */
+    if (stats == NULL) {
+	if (verbose > 1)
+	    printf("\nCalibrating libc malloc\n");
+	if ((stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t))) == NULL)
+	    unix_error("calloc failed in calibrate_libc");
+	eval_libc(tracefiles, num_tracefiles, stats);
+    }
+    for (i = 0; i < num_tracefiles; i++) {
+	if (stats[i].valid) {
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	}
+    }
+    if (stats != libc_stats)
+	free(stats);
+    if (secs <= 0 || ops <= 0)
+	return AVG_LIBC_THRUPUT;
+    thruput = ops / secs;
+
+    /* Cache it for the next run on this host (best effort) */
+    if ((fp = fopen(path, "w")) != NULL) {
+	fprintf(fp, "%lu %.0f\n", key, thruput);
+	fclose(fp);
+    }
+    return thruput;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,7 +1635,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    long long i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -847,6 +1650,23 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if ((p = libc_memalign(trace->ops[i].align, 
+				   trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
@@ -858,6 +1678,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    break;
 	    
         case FREE: /* free */
+        case SIZED_FREE:
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
@@ -876,8 +1697,8 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    long long i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -891,6 +1712,22 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = libc_memalign(trace->ops[i].align, size)) == NULL)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -902,6 +1739,7 @@ static void eval_libc_speed(void *ptr)
 	    break;
 	    
         case FREE: /* free */
+        case SIZED_FREE:
 	    index = trace->ops[i].index;
 	    block = trace->blocks[index];
 	    free(block);
@@ -910,13 +1748,30 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/*
+ * libc_memalign - memalign in terms of posix_memalign, which wants the
+ *    alignment to be at least the size of a pointer
+ */
+static void *libc_memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *))
+	alignment = sizeof(void *);
+    if (posix_memalign(&p, alignment, size) != 0)
+	return NULL;
+    return p;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * printresults - prints a performance summary for some malloc package.
+ *     The total time-weighted utilization is the ratio of the summed
+ *     integrals, not the mean of the traces' ratios.
  */
 static void printresults(int n, stats_t *stats) 
 {
@@ -924,54 +1779,293 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double live_integral = 0;
+    double heap_integral = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%6s%8s%10s%6s\n", 
+	   "trace", " valid", "util", "twutl", "ops", "secs", "Kops");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
+		   stats[i].heap_integral > 0 ?
+		   stats[i].live_integral/stats[i].heap_integral*100.0 : 0.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    live_integral += stats[i].live_integral;
+	    heap_integral += stats[i].heap_integral;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%6s%8s%10s%6s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
 		   "-");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
+	       heap_integral > 0 ? live_integral/heap_integral*100.0 : 0.0,
 	       ops, 
 	       secs,
 	       (ops/1e3)/secs);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%6s%8s%10s%6s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
+	       "-", 
 	       "-");
     }
 
 }
 
+/*
+ * printcachesim - prints the modeled metadata cache traffic of mm malloc.
+ *    The counts come from the utilization pass, which replays the trace
+ *    exactly once.
+ */
+static void printcachesim(int n, stats_t *stats, char *spec)
+{
+    int i;
+    int valid = 0;
+    double accesses = 0;
+    double misses = 0;
+
+    printf("Modeled metadata cache (%s sets:ways:line):\n", spec);
+    printf("%5s%10s%10s\n", "trace", "acc/op", "miss/op");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.2f%10.3f\n", i, stats[i].accesses, stats[i].misses);
+	    accesses += stats[i].accesses;
+	    misses += stats[i].misses;
+	    valid++;
+	}
+	else
+	    printf("%2d%13s%10s\n", i, "-", "-");
+    }
+    if (valid > 0)
+	printf("%5s%10.2f%10.3f\n", "Avg", accesses/valid, misses/valid);
+}
+
+/*
+ * printarena - prints the throughput of the arena replay next to that of
+ *    the regular replay with individual frees. A trace whose phases 
+ *    do not fit in the heap without reuse gets no arena numbers.
+ */
+static void printarena(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Arena replay (frees dropped, arena reset when the live set empties):\n");
+    printf("%5s%8s%10s%12s%9s\n", 
+	   "trace", "phases", "mm Kops", "arena Kops", "speedup");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].arena_valid) {
+	    printf("%2d%11.0f%10.0f%12.0f%8.2fx\n", 
+		   i,
+		   stats[i].phases,
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].arena_secs,
+		   stats[i].secs/stats[i].arena_secs);
+	}
+	else if (stats[i].valid) {
+	    printf("%2d%11s%10.0f%12s%9s\n", 
+		   i, "-", (stats[i].ops/1e3)/stats[i].secs, "-", "-");
+	}
+	else
+	    printf("%2d%11s%10s%12s%9s\n", i, "-", "-", "-", "-");
+    }
+}
+
+/*
+ * printverify - prints the throughput of each trace without and with
+ *    the heap verifier of -c, and how much checking it did per op
+ */
+static void printverify(int n, stats_t *stats, long long interval)
+{
+    int i;
+    double ops = 0, secs = 0, verify_secs = 0, blocks = 0, walks = 0;
+
+    printf("Heap verification (full walk every %lld ops):\n", interval);
+    printf("%5s%10s%10s%10s%10s%10s%8s\n", "trace", "ops", "Kops", 
+	   "checked", "overhead", "blocks/op", "walks");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.0f%10.0f%10.0f%9.0f%%%10.2f%8.0f\n", 
+		   i,
+		   stats[i].ops,
+		   stats[i].ops/1e3/stats[i].secs,
+		   stats[i].ops/1e3/stats[i].verify_secs,
+		   (stats[i].verify_secs/stats[i].secs - 1)*100.0,
+		   stats[i].verify_blocks/stats[i].ops,
+		   stats[i].verify_walks);
+	    ops += stats[i].ops;
+	    secs += stats[i].secs;
+	    verify_secs += stats[i].verify_secs;
+	    blocks += stats[i].verify_blocks;
+	    walks += stats[i].verify_walks;
+	}
+	else
+	    printf("%2d%13s%10s%10s%10s%10s%8s\n", i, "-", "-", "-", "-", "-", "-");
+    }
+    if (secs > 0)
+	printf("%5s%10.0f%10.0f%10.0f%9.0f%%%10.2f%8.0f\n", "Total", 
+	       ops, ops/1e3/secs, ops/1e3/verify_secs,
+	       (verify_secs/secs - 1)*100.0, blocks/ops, walks);
+}
+
+/*
+ * printcompact - prints the average utilization just before and just
+ *    after each compaction of the handle replay
+ */
+static void printcompact(int n, stats_t *stats, long long interval)
+{
+    int i;
+    double compactions = 0, before = 0, after = 0;
+    int valid = 0;
+
+    printf("Handle replay (mm_compact every %lld ops):\n", interval);
+    printf("%5s%13s%8s%8s\n", "trace", "compactions", "before", "after");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].compactions > 0) {
+	    printf("%2d%16.0f%7.0f%%%7.0f%%\n", 
+		   i,
+		   stats[i].compactions,
+		   stats[i].util_before*100.0,
+		   stats[i].util_after*100.0);
+	    compactions += stats[i].compactions;
+	    before += stats[i].util_before;
+	    after += stats[i].util_after;
+	    valid++;
+	}
+	else
+	    printf("%2d%16s%8s%8s\n", i, "-", "-", "-");
+    }
+    if (valid > 0)
+	printf("%5s%13.0f%7.0f%%%7.0f%%\n", "Avg", 
+	       compactions/valid, before/valid*100.0, after/valid*100.0);
+}
+
+/*
+ * printhints - prints the utilization of each trace without and with
+ *    the oracle lifetime hints of -L
+ */
+static void printhints(int n, stats_t *stats, int percent)
+{
+    int i;
+    double long_lived = 0, util = 0, hint_util = 0;
+    int valid = 0;
+
+    printf("Oracle lifetime hints (long-lived if alive for %d%% of the trace):\n", 
+	   percent);
+    printf("%5s%10s%8s%8s\n", "trace", "long", "util", "hinted");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%12.1f%%%7.0f%%%7.0f%%\n", 
+		   i,
+		   stats[i].long_lived*100.0,
+		   stats[i].util*100.0,
+		   stats[i].hint_util*100.0);
+	    long_lived += stats[i].long_lived;
+	    util += stats[i].util;
+	    hint_util += stats[i].hint_util;
+	    valid++;
+	}
+	else
+	    printf("%2d%13s%8s%8s\n", i, "-", "-", "-");
+    }
+    if (valid > 0)
+	printf("%5s%9.1f%%%7.0f%%%7.0f%%\n", "Avg", 
+	       long_lived/valid*100.0, util/valid*100.0, hint_util/valid*100.0);
+}
+
+/*
+ * printpredict - prints how many mallocs the lifetime predictor sent
+ *    to the long-lived region, and how often it was wrong about the
+ *    blocks it sampled
+ */
+static void printpredict(int n, stats_t *stats)
+{
+    int i;
+    double predicted = 0, predicted_long = 0, samples = 0, mispredicts = 0;
+
+    printf("Lifetime prediction:\n");
+    printf("%5s%10s%8s%9s%8s%8s\n", "trace", "mallocs", "long", 
+	   "sampled", "wrong", "util");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].predicted > 0) {
+	    printf("%2d%13.0f%7.1f%%%9.0f%7.1f%%%7.0f%%\n", 
+		   i,
+		   stats[i].predicted,
+		   stats[i].predicted_long/stats[i].predicted*100.0,
+		   stats[i].lifetime_samples,
+		   stats[i].lifetime_samples > 0 ?
+		   stats[i].lifetime_mispredicts/stats[i].lifetime_samples*100.0 : 0,
+		   stats[i].util*100.0);
+	    predicted += stats[i].predicted;
+	    predicted_long += stats[i].predicted_long;
+	    samples += stats[i].lifetime_samples;
+	    mispredicts += stats[i].lifetime_mispredicts;
+	}
+	else
+	    printf("%2d%13s%8s%9s%8s%8s\n", i, "-", "-", "-", "-", "-");
+    }
+    if (predicted > 0)
+	printf("%5s%10.0f%7.1f%%%9.0f%7.1f%%\n", "Total", 
+	       predicted, predicted_long/predicted*100.0, samples,
+	       samples > 0 ? mispredicts/samples*100.0 : 0);
+}
+
+/*
+ * printbins - prints how often mallocs were served from an exact-size
+ *    bin, and how often bins were handed out and taken back
+ */
+static void printbins(int n, stats_t *stats)
+{
+    int i;
+    double lookups = 0, hits = 0, promotions = 0, demotions = 0;
+
+    printf("Exact-size bins:\n");
+    printf("%5s%10s%10s%10s%10s\n", "trace", "lookups", "hit rate", 
+	   "promoted", "demoted");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].bin_lookups > 0) {
+	    printf("%2d%13.0f%9.0f%%%10.0f%10.0f\n", 
+		   i,
+		   stats[i].bin_lookups,
+		   stats[i].bin_hits/stats[i].bin_lookups*100.0,
+		   stats[i].bin_promotions,
+		   stats[i].bin_demotions);
+	    lookups += stats[i].bin_lookups;
+	    hits += stats[i].bin_hits;
+	    promotions += stats[i].bin_promotions;
+	    demotions += stats[i].bin_demotions;
+	}
+	else
+	    printf("%2d%13s%10s%10s%10s\n", i, "-", "-", "-", "-");
+    }
+    if (lookups > 0)
+	printf("%5s%10.0f%9.0f%%%10.0f%10.0f\n", "Total", 
+	       lookups, hits/lookups*100.0, promotions, demotions);
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -993,10 +2087,10 @@ void unix_error(char *msg)
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %lld]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
 /* 
@@ -1004,14 +2098,27 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValrA] [-f <file>] [-t <dir>] [-c <n>] [-C <spec>] [-E <file>] [-H <n>] [-L <pct>] [-o <opts>] [-T <points>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A         Compare against replaying through arenas.\n");
+    fprintf(stderr, "\t-c <n>     Also time replays that verify the heap, walking all of it every <n> ops.\n");
+    fprintf(stderr, "\t-C <spec>  Model metadata cache misses, spec is <sets>:<ways>:<line>\n");
+    fprintf(stderr, "\t           (needs \"make CACHESIM=1\").\n");
+    fprintf(stderr, "\t-E <file>  Dump each thread's last mm operations of the utilization replays\n");
+    fprintf(stderr, "\t           to <file> for mmevents (%d of them, or -o events=<n>).\n", EVENTS);
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <n>     Replay through handles, compacting every <n> ops.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L <pct>   Replay with lifetime hints, long-lived if alive for <pct>%% of a trace.\n");
+    fprintf(stderr, "\t-o <opts>  Set mm options, e.g. fit=next (see mm_config in mm.h); the\n");
+    fprintf(stderr, "\t           MM_CONFIG environment variable takes the same string.\n");
+    fprintf(stderr, "\t-r         Remeasure libc throughput, ignoring the cache.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <list>  Count mm tracepoints, e.g. find_fit,coalesce or all, and time\n");
+    fprintf(stderr, "\t           find_fit (needs \"make TRACE=1\").\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
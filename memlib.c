@@ -8,16 +8,39 @@
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* 
+ * A heap file starts with one page holding this header, followed by 
+ * MAX_HEAP bytes of heap. The brk is kept as an offset so the file 
+ * can be mapped at a different address next time, or by several
+ * processes at once. A shared memory object has the same layout.
+ */
+#define MEM_FILE_MAGIC 0x6d656d66696c65UL
+
+typedef struct {
+    unsigned long magic;  /* MEM_FILE_MAGIC */
+    size_t heapsize;      /* MAX_HEAP of the process that created the file */
+    size_t brk;           /* current heap size */
+} mem_filehdr_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_filehdr_t *mem_hdr; /* header page of a heap file, or NULL */
+static size_t mem_maplen;    /* length of the heap file mapping */
+
+/* Other processes may have moved the brk of a mapped heap */
+#define SYNC_BRK() if (mem_hdr) mem_brk = mem_start_brk + mem_hdr->brk
+
+static int mem_map_fd(int fd);
 
 /* 
  * mem_init - initialize the memory system model
@@ -32,14 +55,94 @@ void mem_init(void)
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_hdr = NULL;
+}
+
+/*
+ * mem_init_file - initialize the memory system model with the heap
+ *    kept in the file at path, which is created if need be. A heap left
+ *    in the file by an earlier process is mapped back in, though not
+ *    necessarily at the same address. Returns -1 with errno set if the
+ *    file cannot be used.
+ */
+int mem_init_file(const char *path)
+{
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+	return -1;
+    return mem_map_fd(fd);
+}
+
+/*
+ * mem_init_shared - initialize the memory system model with the heap
+ *    kept in the POSIX shared memory object name, which is created if
+ *    need be. Every process that calls this with the same name, or that
+ *    is forked afterwards, works on the same heap (see mm_share). The
+ *    caller removes the object with shm_unlink when done. Returns -1 
+ *    with errno set if the object cannot be used.
+ */
+int mem_init_shared(const char *name)
+{
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0600)) < 0)
+	return -1;
+    return mem_map_fd(fd);
+}
+
+/*
+ * mem_map_fd - map the heap file (or shared memory object) open on fd,
+ *    growing it and writing a new header if need be, and close fd
+ */
+static int mem_map_fd(int fd)
+{
+    size_t pagesize = mem_pagesize();
+    struct stat st;
+    void *map;
+
+    mem_maplen = pagesize + MAX_HEAP;
+    if (fstat(fd, &st) < 0 ||
+	((size_t)st.st_size < mem_maplen && ftruncate(fd, mem_maplen) < 0)) {
+	close(fd);
+	return -1;
+    }
+    map = mmap(NULL, mem_maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return -1;
+
+    mem_hdr = (mem_filehdr_t *)map;
+    if (mem_hdr->magic != MEM_FILE_MAGIC) {  /* a new file */
+	mem_hdr->magic = MEM_FILE_MAGIC;
+	mem_hdr->heapsize = MAX_HEAP;
+	mem_hdr->brk = 0;
+    }
+    else if (mem_hdr->heapsize != MAX_HEAP || mem_hdr->brk > MAX_HEAP) {
+	munmap(map, mem_maplen);
+	mem_hdr = NULL;
+	errno = EINVAL;
+	return -1;
+    }
+
+    mem_start_brk = (char *)map + pagesize;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    mem_brk = mem_start_brk + mem_hdr->brk;
+    return 0;
 }
 
 /* 
- * mem_deinit - free the storage used by the memory system model
+ * mem_deinit - free the storage used by the memory system model. A 
+ *    heap file is unmapped, leaving the heap in it.
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_hdr) {
+	munmap(mem_hdr, mem_maplen);
+	mem_hdr = NULL;
+    }
+    else
+	free(mem_start_brk);
 }
 
 /*
@@ -48,23 +151,29 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    if (mem_hdr)
+	mem_hdr->brk = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, but not below its start.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    SYNC_BRK();
+    old_brk = mem_brk;
+    if ( (incr < mem_start_brk - mem_brk) || (incr > mem_max_addr - mem_brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_hdr)
+	mem_hdr->brk = mem_brk - mem_start_brk;
     return (void *)old_brk;
 }
 
@@ -81,6 +190,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
+    SYNC_BRK();
     return (void *)(mem_brk - 1);
 }
 
@@ -89,6 +199,7 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
+    SYNC_BRK();
     return (size_t)(mem_brk - mem_start_brk);
 }
 
@@ -1,8 +1,11 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
+int mem_init_file(const char *path);
+int mem_init_shared(const char *name);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
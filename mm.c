@@ -20,15 +20,138 @@
  *    new size is greater than old size, then we allocate a new block with malloc, copy
  *    the old data into the new block and free the old block. If the new size is same
  *    as the old size, then the same block is returned.
+ *
+ * => mm_calloc, mm_memalign and mm_free_sized are built on top of these. mm_memalign
+ *    looks for a free block with room at an aligned address, or else carves one from
+ *    the wilderness at its first aligned address. It gives the misaligned front of the
+ *    block back to the free list and trims the tail the same way mm_realloc shrinks a
+ *    block. Blocks carved back to back from the wilderness pack without fronts.
+ *
+ * => The handle API (mm_halloc and friends) hands out movable blocks. A handle is an
+ *    index into a table of block pointers, and each movable block keeps its index in
+ *    its first word. The table is a movable block itself, at index 0, so that it does
+ *    not pin the heap. mm_compact walks the heap, slides every movable block that is
+ *    not locked down over the free space below it, rebuilds the free list from the
+ *    holes that are left and trims the heap.
+ *
+ * => All of the allocator's state lives in a struct at the start of the heap, and
+ *    every address kept in the heap (free list links, handle slots, the root) is an
+ *    offset from the start of the heap. A heap in a file mapped by mem_init_file
+ *    can therefore be mapped again at another address and picked up by mm_attach.
+ *
+ * => After mm_share, the public functions take a process-shared lock kept in the
+ *    state, so processes sharing the heap's mapping (see mem_init_shared) can all
+ *    allocate from it. The public functions are thin wrappers that take the lock
+ *    around the *_block routines, which call each other without locking again.
+ *    Bins, lifetime prediction and verify are driven by history kept in process
+ *    statics (the sketch, the samples, the touched blocks), so each process would
+ *    steer the shared bins by its own view; mm_share and mm_attach of a shared heap
+ *    turn them off, and mm_config refuses to turn them back on.
+ *
+ * => mm_config picks the fit policy at run time, by pointing fit_search at the search
+ *    that find_fit calls, so the policy costs no test per malloc. First fit (the
+ *    default) searches from the head of the free list. Next fit resumes from a
+ *    roving pointer left by the previous search; remove_block moves the rover along
+ *    when the block it points to leaves the free list. Good fit looks at up to
+ *    good_k fitting blocks, or stops at one that wastes at most good_x percent of
+ *    the request, and takes the tightest of those it looked at.
+ *
+ * => With mm_config "bins=n", up to n request sizes that are hot in the recent
+ *    malloc history get an exact-size bin. A small count-min sketch of adjusted sizes
+ *    finds them; it is halved every SKETCH_PERIOD mallocs so that sizes cool. Freed
+ *    blocks of a binned size are pushed onto the bin still marked allocated, so they
+ *    neither coalesce nor need searching, and mallocs of that size pop them. A bin
+ *    whose size has cooled is demoted and its blocks go back to the free list.
+ *
+ * => mm_malloc_fast and mm_free_fast, inline in mm.h, keep small freed blocks in a
+ *    per-thread cache and only call in here when it is empty or full. The slow path
+ *    rounds requests up to their 16-byte class so every block it returns can be cached.
+ *    Cached blocks stay allocated as far as the heap is concerned.
+ *
+ * => The free block at the top of the heap is the wilderness. It is on no free list, so
+ *    a malloc that finds no fit bumps its block off the front of the wilderness with two
+ *    header writes, and the heap grows only by what the wilderness lacks. A block freed
+ *    next to the wilderness joins it.
+ *
+ * => With mm_config "predict=size", mm_malloc guesses the lifetime itself. One block in
+ *    SAMPLE_PERIOD is followed in a small table until it is freed, or until it has
+ *    outlived life_mallocs mallocs, and the outcome is counted for its class: a hash of
+ *    its size, and with "predict=site" of the caller's return address too. A class
+ *    where most followed blocks lived long has its blocks put in the long-lived region
+ *    described next.
+ *
+ * => mm_malloc_hint(size, MM_LONG_LIVED) allocates from a second region kept apart
+ *    from the short-lived one. Every block carries the region bit (0x4) of the memory
+ *    it was carved from, each region has its own free list, and coalescing never
+ *    merges blocks of different regions. A long-lived request that finds no fit in
+ *    its region claims a whole short-lived free block for it, or grows the heap with
+ *    long-lived space. Short-lived requests may borrow long-lived memory, which goes
+ *    back to that region when freed.
+ *
+ * => mm_realloc copies a moved payload with copy_payload. Below stream_min bytes it
+ *    uses an SSE2 loop of unaligned loads and aligned stores; from stream_min up it
+ *    uses non-temporal stores, which write around the cache, since the old block is
+ *    freed right after and the new one is rarely read back at once. mm_config "copy"
+ *    picks either loop for every size, or the C library's memcpy.
+ *
+ * => With mm_config "verify=n", every malloc, free, realloc and memalign checks the
+ *    blocks it touched before returning: the blocks it placed, split off or coalesced,
+ *    their neighbours, and their free-list links. Every n of those operations
+ *    verify_heap walks the whole heap and both free lists and checks that they agree.
+ *    A failed check prints what it found and aborts. mm_verify runs the full walk on
+ *    demand.
+ *
+ * => With mm_config "events=n", the public functions append each operation to the
+ *    calling thread's ring of the last n (events.c): what was asked for, the block
+ *    returned or freed, how many free blocks the search looked at, and whether it
+ *    split, coalesced or grew the heap. The searches, place, coalesce and extend_heap
+ *    count into ev_visits and ev_flags whether or not events are on, so they carry no
+ *    test; the EVENT macro records and clears them only when they are.
+ *
+ * => mm_init applies the options in the MM_CONFIG environment variable, so the
+ *    policies and thresholds can be tuned without rebuilding: the initial heap and the
+ *    least it grows by, the smallest remainder worth splitting off, the wilderness size
+ *    past which a free gives it back, the block size from which find_fit looks for the
+ *    best fit whatever the policy, and the blocks each thread cache keeps.
+ *    Thresholds are plain variables the code compares against; an option that is off
+ *    is a threshold no size reaches, not a flag tested on every call. Options that
+ *    need work on every call (bins, prediction, verify, events, stats, and the lock
+ *    of a shared heap) are checked once instead: select_paths, run whenever one may
+ *    have changed, points mm_malloc and mm_free at plain paths that test none of
+ *    them, at the checked paths if any but events and stats is on, or at the plain
+ *    paths followed by the inline recording and counting if only those two are. The
+ *    other public functions keep their tests, and TOUCH stays in place, coalesce and
+ *    carve_wild, which all the paths share; duplicating the block layer for one load
+ *    and a branch that always goes the same way is not worth it.
+ *
+ * => With mm_config "stats=name", the public functions keep live statistics in the
+ *    shared memory object /name (statpage.c) for a monitor such as mmstat to sample:
+ *    operation counts, mallocs per size class, live and heap bytes, and how often the
+ *    shared heap lock was found taken. Each operation counts itself in stat_batch as
+ *    its last step, under the heap lock if there is one, and every STAT_BATCH
+ *    operations the batch is added to the page inside the page's seqlock, so a reader
+ *    never sees half an update and never blocks the allocator. The page lags the heap
+ *    by fewer than STAT_BATCH operations, except that a change of heap size by
+ *    mm_init or mm_compact shows at once. Blocks held in thread caches count as live.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "mmtrace.h"
+#include "events.h"
+#include "statpage.h"
+#ifdef CACHESIM
+#include "cachesim.h"
+#endif
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -61,30 +184,217 @@ team_t team = {
 #define DSIZE 8                                                                             //Size of a double word
 #define CHUNKSIZE 16                                                                        //Initial heap size
 #define OVERHEAD 24                                                                         //The minimum block size
+#define MAX_BLOCK 0xFFFFFFF8                                                                //The largest block size a header word can hold
 #define MAX(x ,y)  ((x) > (y) ? (x) : (y))                                                  //Finds the maximum of two numbers
 #define PACK(size, alloc)  ((size) | (alloc))                                               //Put the size and allocated byte into one word
-#define GET(p)  (*(size_t *)(p))                                                            //Read the word at address p
-#define PUT(p, value)  (*(size_t *)(p) = (value))                                           //Write the word at address p
+#define GET(p)  (*(unsigned int *)(p))                                                      //Read the word at address p
+#define PUT(p, value)  (*(unsigned int *)(p) = (value))                                     //Write the word at address p
 #define GET_SIZE(p)  (GET(p) & ~0x7)                                                        //Get the size from header/footer
 #define GET_ALLOC(p)  (GET(p) & 0x1)                                                        //Get the allocated bit from header/footer
+#define GET_MOVABLE(p)  (GET(p) & 0x2)                                                      //Get the movable bit of an allocated block's header/footer
+#define LONG_LIVED 0x4                                                                      //The region bit of blocks in the long-lived region
+#define GET_REGION(p)  (GET(p) & LONG_LIVED)                                                //Get the region bit from header/footer
+#define WILD_SIZE()  (state->wild ? GET_SIZE(HDRP(to_ptr(state->wild))) : 0)                //Get the size of the wilderness
+#define SENTINEL()  ((void *)HEAP_LISTP() + DSIZE)                                          //Get the prologue, which ends both free lists
 #define HDRP(bp)  ((void *)(bp) - WSIZE)                                                    //Get the address of the header of a block
 #define FTRP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)                               //Get the address of the footer of a block
 #define NEXT_BLKP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)))                                  //Get the address of the next block
 #define PREV_BLKP(bp)  ((void *)(bp) - GET_SIZE(HDRP(bp) - WSIZE))                          //Get the address of the previous block
-#define NEXT_FREEP(bp)  (*(void **)(bp + DSIZE))                                            //Get the address of the next free block
-#define PREV_FREEP(bp)  (*(void **)(bp))                                                    //Get the address of the previous free block
+#define GETL(p)  (*(size_t *)(p))                                                           //Read the link (heap offset) at address p
+#define PUTL(p, value)  (*(size_t *)(p) = (value))                                          //Write the link (heap offset) at address p
+#define NEXT_FREEP(bp)  to_ptr(GETL((void *)(bp) + DSIZE))                                  //Get the address of the next free block
+#define PREV_FREEP(bp)  to_ptr(GETL(bp))                                                    //Get the address of the previous free block
+#define SET_NEXT_FREEP(bp, p)  PUTL((void *)(bp) + DSIZE, to_off(p))                        //Set the address of the next free block
+#define SET_PREV_FREEP(bp, p)  PUTL(bp, to_off(p))                                          //Set the address of the previous free block
+#define HINDEX(bp)  (*(size_t *)(bp))                                                       //Get the handle of a movable block
+#define HSLOT(h)  (((struct mm_hslot *)to_ptr(state->hslots))[h])                           //Get slot h of the handle table
+#define HEAP_LISTP()  ((char *)state + STATE_SIZE)                                          //Get the address of the space for the prologue and epilogue
+#define FIRST_BLKP()  (HEAP_LISTP() + 2 * OVERHEAD)                                         //Get the address of the first block, past the space mm_init takes
+#define HSLOTS 64                                                                           //The initial number of handle slots
+#define STATE_SIZE ALIGN(sizeof(struct mm_state))                                           //The space the allocator state takes at the start of the heap
+#define SHARED()  (state && state->shared)                                                  //Whether other processes may be using the heap
+#define MM_MAGIC 0x6d6d68656170UL                                                           //Marks a heap that mm_init has finished setting up
+#define LOCK()  if(state->shared) lock_heap()                                               //Take the heap lock if the heap is shared
+#define UNLOCK()  if(state->shared) pthread_mutex_unlock(&state->lock)                      //Release the heap lock if the heap is shared
+#define TOUCH(bp)  if(verify_every) note_touched(bp)                                        //Have the verifier check a block after this operation
+#define VERIFY()  if(verify_every) verify_op()                                              //Check the blocks this operation touched
+#define VERIFY_REGION(bp, region)  if(verify_every) verify_region(bp, region)               //Check that a block came from the region asked for
+#define EVENT(op, size, bp)  if(mm_events_size) record_event(op, size, bp)                  //Append the operation to the thread's event ring
+#define PUBLISH(op, size, added, removed)  if(statpage) publish(op, size, added, removed)   //Count the operation in the shared stats page
+#define NEVER ((size_t)-1)                                                                  //A threshold no size reaches
+#define MAX_OPTLEN 32                                                                       //The longest option name or value mm_config accepts
+#define MAX_BINS 8                                                                          //The most exact-size bins there can be
+#define BIN_MAX 64                                                                          //The most blocks a bin holds
+#define SKETCH_ROWS 2                                                                       //Hash functions of the size sketch
+#define SKETCH_BITS 7                                                                       //log2 of the counters per row
+#define SKETCH_PERIOD 1024                                                                  //Mallocs between halvings of the sketch
+#define HOT_COUNT 32                                                                        //Sketch count at which a size gets a bin
+#define COLD_COUNT 4                                                                        //Sketch count below which a bin is demoted
+#define PREDICT_OFF 0                                                                       //mm_malloc does not predict lifetimes
+#define PREDICT_SIZE 1                                                                      //Predict from the request size
+#define PREDICT_SITE 2                                                                      //Predict from the request size and the caller
+#define PREDICT_BITS 8                                                                      //log2 of the lifetime classes
+#define SAMPLE_BITS 6                                                                       //log2 of the sampled blocks followed at once
+#define SAMPLE_PERIOD 8                                                                     //Predicted mallocs per sampled block
+#define LIFE_MAX 64                                                                         //Deaths a class remembers before halving its counts
+#define COPY_AUTO 0                                                                         //Copy with the vector loop, or streaming stores from stream_min up
+#define COPY_LIBC 1                                                                         //Copy with memcpy
+#define COPY_VECTOR 2                                                                       //Copy with the vector loop
+#define COPY_STREAM 3                                                                       //Copy with streaming stores
+#define VERIFY_TOUCHED 8                                                                    //The most blocks one operation has checked
+#define STAT_BATCH 64                                                                       //Operations counted between updates of the stats page
+
+#ifdef CACHESIM                                                                             //Route every metadata access through the cache model
+#undef GET
+#undef PUT
+#undef GETL
+#undef PUTL
+#define GET(p)  (*(unsigned int *)cachesim_load(p))
+#define PUT(p, value)  (*(unsigned int *)cachesim_store(p) = (value))
+#define GETL(p)  (*(size_t *)cachesim_load(p))
+#define PUTL(p, value)  (*(size_t *)cachesim_store(p) = (value))
+#endif
 
-static char *heap_listp = 0;                                                                //Pointer to the first block
-static char *free_listp = 0;                                                                //Pointer to the first free block
+/**
+ * @brief The allocator state, kept at the start of the heap. Addresses are heap offsets.
+ */
+struct mm_state {
+    size_t magic;                                                                           //MM_MAGIC once the heap is set up
+    size_t free_list;                                                                       //The first free block
+    size_t long_list;                                                                       //The first free block of the long-lived region
+    size_t wild;                                                                            //The free block at the top of the heap, kept off the free lists, or 0
+    size_t hslots;                                                                          //The handle table, or 0 until the first mm_halloc
+    size_t num_hslots;                                                                      //The number of slots in the handle table
+    size_t free_hslot;                                                                      //The first unused handle slot, or 0 if there is none
+    size_t root;                                                                            //The block set by mm_set_root, or 0
+    size_t rover;                                                                           //The free block next fit resumes from, or 0 for the head
+    size_t shared;                                                                          //Whether mm_share has been called and lock must be taken
+    pthread_mutex_t lock;                                                                   //The process-shared heap lock
+    struct mm_bin {
+        unsigned int size;                                                                  //The block size of the bin, or 0 if unused
+        unsigned int count;                                                                 //The number of blocks in it
+        size_t head;                                                                        //The first block, linked through its first word
+    } bins[MAX_BINS];                                                                       //The exact-size bins
+    mm_stats_t stats;                                                                       //The counters mm_get_stats reports
+};
+
+/**
+ * @brief A slot of the handle table: the block of a movable block and how often it is
+ * locked. Unused slots have an off of 0 and are chained through pins.
+ */
+struct mm_hslot {
+    size_t off;                                                                             //The heap offset of the block
+    size_t pins;                                                                            //The number of mm_hlock calls not yet undone, or the next unused slot
+};
+
+static struct mm_state *state = 0;                                                          //Pointer to the start of the heap, where the state lives
+static void *find_head_fit(size_t size);
+static void *(*fit_search)(size_t size) = find_head_fit;                                    //The search find_fit uses, set by mm_config
+static void *malloc_plain(size_t size, void *site);
+static void free_plain(void *bp);
+static void *(*malloc_path)(size_t size, void *site) = malloc_plain;                        //What mm_malloc runs, picked by select_paths
+static void (*free_path)(void *bp) = free_plain;                                            //and what mm_free runs
+static size_t heap_chunk = CHUNKSIZE;                                                       //Bytes mm_init starts the wilderness with
+static size_t grow_min = 0;                                                                 //The least the heap grows by at a time
+static size_t split_min = OVERHEAD;                                                         //The smallest remainder place splits off
+static size_t trim_min = NEVER;                                                             //Wilderness bytes past which a free gives it back
+static size_t large_min = NEVER;                                                            //Block size from which find_fit takes the best fit
+unsigned int mm_tcache_max = MM_TCACHE_MAX;                                                 //Blocks a thread cache class keeps
+static size_t good_k = 8;                                                                   //Fits good fit looks at, 0 for all of them
+static size_t good_x = 10;                                                                  //Percent of the request good fit may waste and stop early
+static size_t num_bins = 0;                                                                 //Bins hot sizes may get, set by mm_config
+static unsigned short sketch[SKETCH_ROWS][1 << SKETCH_BITS];                                //Recent malloc counts of adjusted sizes
+static unsigned int sketch_ticks = 0;                                                       //Mallocs since the sketch was last halved
+__thread mm_tcache_t mm_tcache;                                                             //The blocks mm_free_fast kept for this thread
+static int predict_mode = PREDICT_OFF;                                                      //How mm_malloc predicts lifetimes, set by mm_config
+static size_t life_mallocs = 256;                                                           //Mallocs a block must outlive to count as long-lived
+static size_t malloc_clock = 0;                                                             //Predicted mallocs so far, the clock lifetimes are measured in
+static struct {
+    unsigned short longs;                                                                   //Sampled blocks of the class that lived long
+    unsigned short shorts;                                                                  //and that died young
+} lifetimes[1 << PREDICT_BITS];                                                             //Recent lifetimes per size (and caller) class
+static int copy_mode = COPY_AUTO;                                                           //How realloc_block copies payloads, set by mm_config
+static size_t stream_min = 1 << 20;                                                         //Bytes from which COPY_AUTO streams
+static size_t verify_every = 0;                                                             //Operations between full heap walks, 0 to not verify
+static size_t verify_ops = 0;                                                               //Operations since the last full walk
+static void *touched[VERIFY_TOUCHED];                                                       //The blocks the current operation touched
+static int num_touched = 0;                                                                 //and how many there are
+static __thread unsigned int ev_visits;                                                     //Free blocks the current operation looked at
+static __thread unsigned int ev_flags;                                                      //MM_EVF_* for what else it did
+static mm_statpage_t *statpage = NULL;                                                      //The shared page live statistics go to, if any
+static char statpage_name[MAX_OPTLEN + 2];                                                  //and the name of its shared memory object
+static struct {
+    unsigned int ops;                                                                       //Operations counted since the page was last updated
+    unsigned long long mallocs;                                                             //What they add to the page's counters
+    unsigned long long frees;
+    unsigned long long reallocs;
+    unsigned long long live_bytes;                                                          //Wraps below zero when more was freed than handed out
+    unsigned int class_mallocs[MM_STAT_CLASSES];
+} stat_batch;                                                                               //The counts not yet on the stats page
+static struct {
+    size_t off;                                                                             //The sampled block, or 0 if the slot is unused
+    size_t born;                                                                            //The malloc_clock when it was allocated
+    unsigned short cls;                                                                     //Its lifetime class
+    unsigned short predicted;                                                               //Whether it was predicted long-lived
+} samples[1 << SAMPLE_BITS];                                                                //The sampled blocks still allocated
 
 //Function prototypes for helper routines
+static void *malloc_block(size_t size, size_t region);
+static void free_block(void *bp);
+static void *realloc_block(void *bp, size_t size);
+static void *malloc_checked(size_t size, void *site);
+static void free_checked(void *bp);
+static void *malloc_recorded(size_t size, void *site);
+static void free_recorded(void *bp);
+static void release_block(void *bp);
+static void select_paths(void);
+static void *memalign_block(size_t alignment, size_t size);
 static void *extend_heap(size_t words);
+static void *carve_wild(size_t size, size_t region);
+static void *carve_aligned_wild(size_t alignment, size_t size);
 static void place(void *bp, size_t size);
-static void *find_fit(size_t size);
+static void *find_fit(size_t size, size_t region);
+static void *find_first_fit(void *bp, size_t size);
+static void *find_next_fit(size_t size);
+static void *find_good_fit(size_t size);
+static void *find_tightest_fit(size_t size, size_t k, size_t slack);
+static int set_option(const char *name, const char *value);
+static void count_size(size_t size);
+static size_t sketch_count(size_t size, int add);
+static void *bin_pop(size_t size);
+static int bin_push(void *bp);
+static void flush_bin(struct mm_bin *bin);
+static int flush_bins(void);
+static void *predict_malloc(size_t size, void *site);
+static void sample_block(void *bp, size_t cls, size_t predicted);
+static void sample_died(size_t slot, size_t lived);
+static void copy_payload(void *dst, const void *src, size_t n);
+static void copy_vector(char *dst, const char *src, size_t n);
+static void copy_stream(char *dst, const char *src, size_t n);
 static void *coalesce(void *bp);
 static void insert_at_front(void *bp);
 static void remove_block(void *bp);
+static void trim_block(void *bp, size_t size);
+static void trim_wild(void);
+static char *align_in_block(char *bp, size_t alignment);
+static void *find_aligned_fit(size_t alignment, size_t size);
+static void mark_movable(void *bp, mm_handle_t h);
+static int grow_hslots(void);
 static int check_block(void *bp);
+static void note_touched(void *bp);
+static void verify_op(void);
+static void verify_region(void *bp, size_t region);
+static int verify_block(void *bp);
+static int verify_heap(void);
+static int verify_error(const char *msg, void *bp);
+static inline void record_event(int op, size_t size, void *bp);
+static inline void publish(int op, size_t size, size_t added, size_t removed);
+static void flush_stats(void);
+static void close_statpage(void);
+static void lock_heap(void);
+static void drop_local_policies(void);
+static inline void *to_ptr(size_t off);
+static inline size_t to_off(void *p);
 
 /**
  * @brief mm_init Initializes the malloc
@@ -92,22 +402,355 @@ static int check_block(void *bp);
  */
 int mm_init(void)
 {
-    if((heap_listp = mem_sbrk(2 * OVERHEAD)) == NULL){                                      //Return error if unable to get heap space
+    char *heap_listp;                                                                       //Pointer to the space for the prologue and epilogue
+    char *opts = getenv("MM_CONFIG");                                                       //Options from the environment, e.g. "fit=next,trim=1048576"
+
+    state = 0;                                                                              //The last heap, shared or not, is gone
+    if(opts && mm_config(opts) == -1){                                                      //A mistyped option should not go unnoticed
+        fprintf(stderr, "mm_init: bad MM_CONFIG \"%s\"\n", opts);
+        return -1;
+    }
+
+    if((state = mem_sbrk(STATE_SIZE + 2 * OVERHEAD)) == (void *)-1){                        //Return error if unable to get heap space
         return -1;
     }
 
+    memset(state, 0, STATE_SIZE);                                                           //No handle table, no root, no bins and no stats yet
+    memset(sketch, 0, sizeof(sketch));                                                      //Forget the history of the last heap
+    sketch_ticks = 0;
+    memset(lifetimes, 0, sizeof(lifetimes));
+    memset(samples, 0, sizeof(samples));
+    malloc_clock = 0;
+    num_touched = 0;
+    verify_ops = 0;
+    memset(&mm_tcache, 0, sizeof(mm_tcache));                                               //Cached blocks belonged to the last heap
+    if(statpage){                                                                           //Nothing of the new heap is live yet
+        flush_stats();                                                                      //but the operations on the last one still count
+        mm_statpage_begin(statpage);
+        statpage->live_bytes = 0;
+        mm_statpage_end(statpage);
+    }
+    heap_listp = HEAP_LISTP();
     PUT(heap_listp, 0);                                                                     //Put the Padding at the start of heap
     PUT(heap_listp + WSIZE, PACK(OVERHEAD, 1));                                             //Put the header block of the prologue
     PUT(heap_listp + DSIZE, 0);                                                             //Put the previous pointer
     PUT(heap_listp + DSIZE + WSIZE, 0);                                                     //Put the next pointer
     PUT(heap_listp + OVERHEAD, PACK(OVERHEAD, 1));                                          //Put the footer block of the prologue
     PUT(heap_listp + WSIZE + OVERHEAD, PACK(0, 1));                                         //Put the header block of the epilogue
-    free_listp = heap_listp + DSIZE;                                                        //Initialize the free list pointer
+    PUT(FIRST_BLKP() - DSIZE, PACK(0, 1));                                                  //Nothing below the first block may look free
+    state->free_list = to_off(heap_listp + DSIZE);                                          //Initialize the free list pointer
+    state->long_list = state->free_list;                                                    //Both lists end at the prologue
+
+    if(extend_heap(heap_chunk / WSIZE) == NULL){                                            //Return error if unable to extend heap space
+        return -1;
+    }
+
+    state->magic = MM_MAGIC;                                                                //The heap can be attached to from now on
+    ev_flags = 0;                                                                           //The first operation recorded is not charged with what came before
+    ev_visits = 0;
+    select_paths();                                                                         //Pick mm_malloc and mm_free for the options in force
+    PUBLISH(0, 0, 0, 0);                                                                    //Show the new heap size
+    return 0;
+}
+
+/**
+ * @brief mm_attach Picks up a heap set up by mm_init, e.g. one in a mapped file
+ * @return Return 0 if successful, -1 if the heap holds no allocator state
+ */
+int mm_attach(void)
+{
+    struct mm_state *heap = mem_heap_lo();
+
+    if(mem_heapsize() < STATE_SIZE + 2 * OVERHEAD || heap->magic != MM_MAGIC){              //If mm_init never finished on this heap
+        return -1;
+    }
+
+    state = heap;                                                                           //Every other address is an offset from here
+    if(state->shared){                                                                      //Another process shares the heap
+        drop_local_policies();
+    }
+    select_paths();
+    return 0;
+}
+
+/**
+ * @brief mm_set_root Records a block to find again after mm_attach
+ * @param bp The block pointer, or NULL
+ */
+void mm_set_root(void *bp)
+{
+    LOCK();
+    state->root = to_off(bp);
+    UNLOCK();
+}
+
+/**
+ * @brief mm_get_root Returns the block recorded by mm_set_root
+ * @return The block pointer, or NULL if none was recorded
+ */
+void *mm_get_root(void)
+{
+    return to_ptr(state->root);
+}
+
+/**
+ * @brief mm_config Sets allocator options, e.g. "fit=next"; they outlast mm_init
+ * @param opts Comma-separated name=value pairs
+ * @return Return 0 if every option was understood, -1 otherwise
+ */
+int mm_config(const char *opts)
+{
+    char name[MAX_OPTLEN + 1];                                                              //The name of the option being parsed
+    char value[MAX_OPTLEN + 1];                                                             //and its value
+    size_t namelen, valuelen;
+    int rc;
+
+    while(*opts){
+        namelen = strcspn(opts, "=,");                                                      //The name runs up to the '='
+        if(opts[namelen] != '=' || namelen > MAX_OPTLEN){
+            return -1;
+        }
+        valuelen = strcspn(opts + namelen + 1, ",");                                        //and the value up to the next ','
+        if(valuelen > MAX_OPTLEN){
+            return -1;
+        }
+
+        memcpy(name, opts, namelen);
+        name[namelen] = '\0';
+        memcpy(value, opts + namelen + 1, valuelen);
+        value[valuelen] = '\0';
+        rc = set_option(name, value);
+        select_paths();                                                                     //The option may have turned a check on or off
+        if(rc == -1){
+            return -1;
+        }
+
+        opts += namelen + 1 + valuelen;
+        if(*opts == ','){                                                                   //Skip to the next pair
+            opts++;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief set_option Sets one allocator option
+ * @param name The option name
+ * @param value Its value
+ * @return Return 0 if the option was understood, -1 otherwise
+ */
+static int set_option(const char *name, const char *value){
+    if(!strcmp(name, "fit")){                                                               //The fit policy: first or next
+        if(!strcmp(value, "first")){
+            fit_search = find_head_fit;
+        }
+        else if(!strcmp(value, "next")){
+            fit_search = find_next_fit;
+        }
+        else if(!strcmp(value, "good")){
+            fit_search = find_good_fit;
+        }
+        else{
+            return -1;
+        }
+        return 0;
+    }
+
+    if(!strcmp(name, "predict")){                                                           //What lifetimes are predicted from
+        if(!strcmp(value, "off")){
+            predict_mode = PREDICT_OFF;
+        }
+        else if(SHARED()){                                                                  //Each process would predict from its own samples
+            return -1;
+        }
+        else if(!strcmp(value, "size")){
+            predict_mode = PREDICT_SIZE;
+        }
+        else if(!strcmp(value, "site")){
+            predict_mode = PREDICT_SITE;
+        }
+        else{
+            return -1;
+        }
+        return 0;
+    }
+
+    if(!strcmp(name, "copy")){                                                              //How realloc copies moved payloads
+        if(!strcmp(value, "auto")){
+            copy_mode = COPY_AUTO;
+        }
+        else if(!strcmp(value, "libc")){
+            copy_mode = COPY_LIBC;
+        }
+        else if(!strcmp(value, "vector")){
+            copy_mode = COPY_VECTOR;
+        }
+        else if(!strcmp(value, "stream")){
+            copy_mode = COPY_STREAM;
+        }
+        else{
+            return -1;
+        }
+        return 0;
+    }
+
+    if(!strcmp(name, "stream")){                                                            //The copy size from which auto streams
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n < 0){
+            return -1;
+        }
+        stream_min = n;
+        return 0;
+    }
+
+    if(!strcmp(name, "verify")){                                                            //Operations between full heap walks
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n < 0 || (n && SHARED())){                     //The touched blocks are process-local
+            return -1;
+        }
+        verify_every = n;
+        verify_ops = 0;
+        num_touched = 0;
+        return 0;
+    }
+
+    if(!strcmp(name, "events")){                                                            //Operations each thread's event ring holds
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n < 0 || n > 1 << 24 || mm_events_enable(n) == -1){
+            return -1;
+        }
+        ev_flags = 0;                                                                       //Drop what was counted while nothing recorded
+        ev_visits = 0;
+        return 0;
+    }
+
+    if(!strcmp(name, "stats")){                                                             //The shared memory object to publish statistics in
+        static int registered = 0;
+
+        if(statpage && !strcmp(statpage_name + 1, value)){                                  //MM_CONFIG names the same page at every mm_init
+            return 0;
+        }
+        close_statpage();
+        if(*value == '\0'){                                                                 //An empty name stops publishing
+            return 0;
+        }
+        if(strchr(value, '/')){
+            return -1;
+        }
+        statpage_name[0] = '/';
+        strcpy(statpage_name + 1, value);
+        if((statpage = mm_statpage_open(statpage_name)) == NULL){
+            return -1;
+        }
+        if(!registered){                                                                    //Leave no object behind at exit
+            atexit(close_statpage);
+            registered = 1;
+        }
+        return 0;
+    }
+
+    if(!strcmp(name, "life")){                                                              //The lifetime, in mallocs, that counts as long
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n <= 0){
+            return -1;
+        }
+        life_mallocs = n;
+        return 0;
+    }
+
+    if(!strcmp(name, "chunk") || !strcmp(name, "grow") || !strcmp(name, "split")
+       || !strcmp(name, "trim") || !strcmp(name, "large") || !strcmp(name, "tcache")){       //The sizes of the heap, its blocks and the thread caches
+        char *end;
+        long long n = strtoll(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n < 0 || n > MAX_BLOCK){
+            return -1;
+        }
+        if(!strcmp(name, "chunk")){
+            heap_chunk = ALIGN(n);
+        }
+        else if(!strcmp(name, "grow")){
+            grow_min = ALIGN(n);
+        }
+        else if(!strcmp(name, "split")){                                                    //A remainder smaller than a block cannot stand alone
+            split_min = MAX(ALIGN(n), OVERHEAD);
+        }
+        else if(!strcmp(name, "trim")){                                                     //0 turns trimming off
+            trim_min = n ? (size_t)n : NEVER;
+        }
+        else if(!strcmp(name, "large")){                                                    //0 turns the cutoff off
+            large_min = n ? (size_t)n : NEVER;
+        }
+        else if(n <= MM_TCACHE_MAX){
+            mm_tcache_max = n;
+        }
+        else{
+            return -1;
+        }
+        return 0;
+    }
+
+    if(!strcmp(name, "k") || !strcmp(name, "x") || !strcmp(name, "bins")){                  //The limits of good fit, and the number of bins
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if(*value == '\0' || *end != '\0' || n < 0){
+            return -1;
+        }
+        if(name[0] == 'k'){
+            good_k = n;
+        }
+        else if(name[0] == 'x'){
+            good_x = n;
+        }
+        else if(n <= MAX_BINS && !(n && SHARED())){                                         //Each process would steer the bins by its own sketch
+            num_bins = n;
+        }
+        else{
+            return -1;
+        }
+        return 0;
+    }
+
+    return -1;                                                                              //Unknown option
+}
+
+/**
+ * @brief mm_share Lets processes that map the heap allocate from it at the same time
+ * @return Return 0 if successful, -1 if the lock could not be set up
+ */
+int mm_share(void)
+{
+    pthread_mutexattr_t attr;
 
-    if(extend_heap(CHUNKSIZE / WSIZE) == NULL){                                             //Return error if unable to extend heap space
+    if(state->shared){                                                                      //If the heap is shared already
+        return 0;
+    }
+
+    if(pthread_mutexattr_init(&attr) != 0){
+        return -1;
+    }
+
+    if(pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||                  //The lock lives in the shared heap
+       pthread_mutex_init(&state->lock, &attr) != 0){
+        pthread_mutexattr_destroy(&attr);
         return -1;
     }
 
+    pthread_mutexattr_destroy(&attr);
+    flush_bins();                                                                           //No process steers the bins from here on
+    drop_local_policies();
+    state->shared = 1;                                                                      //Every public function locks from now on
+    select_paths();
     return 0;
 }
 
@@ -117,107 +760,1152 @@ int mm_init(void)
  * @return The pointer to the start of the allocated block
  */
 void *mm_malloc(size_t size)
+{
+    return malloc_path(size, __builtin_return_address(0));                                  //The caller is the site predict=site learns from
+}
+
+/**
+ * @brief malloc_plain mm_malloc when no option needs a check: no lock, bins, predictor, verifier, events or stats
+ * @param size The payload size
+ * @param site The caller, unused
+ * @return The pointer to the start of the allocated block
+ */
+static void *malloc_plain(size_t size, void *site)
 {
     size_t adjustedsize;                                                                    //The size of the adjusted block
-    size_t extendedsize;                                                                    //The amount by which heap is extended if no fit is found
-    char *bp;                                                                               //Stores the block pointer
+    char *bp;
 
-    if(size <= 0){                                                                          //If requested size is less than 0 then ignore
+    if(size <= 0 || size > MAX_BLOCK - OVERHEAD){                                           //If requested size is 0 or too big for a header then ignore
         return NULL;
     }
 
-    adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                                      //Adjust block size to include overhead and alignment requirements
-
-    if((bp = find_fit(adjustedsize))){                                                      //Traverse the free list for the first fit
-        place(bp, adjustedsize);                                                            //Place the block in the free list
+    adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);
+    if((bp = find_fit(adjustedsize, 0))){                                                   //malloc_block without the bins
+        place(bp, adjustedsize);
         return bp;
     }
 
-    extendedsize = MAX(adjustedsize, CHUNKSIZE);                                            //If no fit is found get more memory to extend the heap
+    return carve_wild(adjustedsize, 0);
+}
+
+/**
+ * @brief malloc_checked mm_malloc with whatever the options turned on
+ * @param size The payload size
+ * @param site The caller, for predict=site
+ * @return The pointer to the start of the allocated block
+ */
+static void *malloc_checked(size_t size, void *site)
+{
+    void *bp;
+
+    LOCK();
+    if(predict_mode){                                                                       //Let the lifetime predictor pick the region
+        bp = predict_malloc(size, predict_mode == PREDICT_SITE ? site : NULL);
+    }
+    else{
+        bp = malloc_block(size, 0);
+    }
+    VERIFY();
+    EVENT(MM_EV_MALLOC, size, bp);
+    PUBLISH(MM_EV_MALLOC, size, bp ? GET_SIZE(HDRP(bp)) : 0, 0);
+    UNLOCK();
+    return bp;
+}
+
+/**
+ * @brief mm_tcache_malloc The slow path of mm_malloc_fast, taken when the thread cache is empty
+ * @param size The payload size
+ * @return The pointer to the start of the allocated block
+ */
+void *mm_tcache_malloc(size_t size)
+{
+    if(size - 1 < MM_MAX_CLASS){                                                            //Round up to the class so the block can be cached when freed
+        size = mm_class_size[mm_size_class(size)];
+    }
+
+    return mm_malloc(size);
+}
+
+/**
+ * @brief mm_tcache_flush Frees every block in the calling thread's cache
+ */
+void mm_tcache_flush(void)
+{
+    void *bp;
+    int c;
+
+    for(c = 0; c < MM_NUM_CLASSES; c++){
+        while((bp = mm_tcache.head[c])){
+            mm_tcache.head[c] = *(void **)bp;
+            mm_free(bp);
+        }
+        mm_tcache.count[c] = 0;
+    }
+}
+
+/**
+ * @brief mm_malloc_hint Allocates a block in the region for its expected lifetime
+ * @param size The payload size
+ * @param hint MM_LONG_LIVED for the long-lived region, anything else for the short-lived one
+ * @return The pointer to the start of the allocated block
+ */
+void *mm_malloc_hint(size_t size, int hint)
+{
+    void *bp;
+
+    LOCK();
+    bp = malloc_block(size, hint == MM_LONG_LIVED ? LONG_LIVED : 0);
+    VERIFY_REGION(bp, hint == MM_LONG_LIVED ? LONG_LIVED : 0);
+    VERIFY();
+    EVENT(MM_EV_HINT, size, bp);
+    PUBLISH(MM_EV_HINT, size, bp ? GET_SIZE(HDRP(bp)) : 0, 0);
+    UNLOCK();
+    return bp;
+}
+
+/**
+ * @brief mm_free Frees a block
+ * @param bp The block to be freed
+ */
+void mm_free(void *bp)
+{
+    if(!bp){                                                                                //If block pointer is null
+        return;                                                                             //return
+    }
+
+    free_path(bp);
+}
+
+/**
+ * @brief free_plain mm_free when no option needs a check
+ * @param bp The block to be freed
+ */
+static void free_plain(void *bp)
+{
+    release_block(bp);                                                                      //free_block without the predictor and the bins
+}
+
+/**
+ * @brief free_checked mm_free with whatever the options turned on
+ * @param bp The block to be freed
+ */
+static void free_checked(void *bp)
+{
+    size_t size;
+
+    LOCK();
+    size = GET_SIZE(HDRP(bp));                                                              //Before coalesce merges it away
+    free_block(bp);
+    VERIFY();
+    EVENT(MM_EV_FREE, size, bp);
+    PUBLISH(MM_EV_FREE, 0, 0, size);
+    UNLOCK();
+}
+
+/**
+ * @brief malloc_recorded The plain mm_malloc, recording and counting the operation when events and stats are the only options on
+ * @param size The payload size
+ * @param site The caller, unused
+ * @return The pointer to the start of the allocated block
+ */
+static void *malloc_recorded(size_t size, void *site)
+{
+    void *bp = malloc_plain(size, site);
+
+    EVENT(MM_EV_MALLOC, size, bp);
+    PUBLISH(MM_EV_MALLOC, size, bp ? GET_SIZE(HDRP(bp)) : 0, 0);
+    return bp;
+}
+
+/**
+ * @brief free_recorded The plain mm_free, recording and counting the operation when events and stats are the only options on
+ * @param bp The block to be freed
+ */
+static void free_recorded(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));                                                       //Before coalesce merges it away
+
+    release_block(bp);
+    EVENT(MM_EV_FREE, size, bp);
+    PUBLISH(MM_EV_FREE, 0, 0, size);
+}
+
+/**
+ * @brief select_paths Points mm_malloc and mm_free at the plain paths if no option needs a per-call check
+ */
+static void select_paths(void)
+{
+    if(SHARED() || predict_mode || num_bins || verify_every){
+        malloc_path = malloc_checked;
+        free_path = free_checked;
+    }
+    else if(mm_events_size || statpage){                                                    //Recording and counting need no lock and no check of their own
+        malloc_path = malloc_recorded;
+        free_path = free_recorded;
+    }
+    else{
+        malloc_path = malloc_plain;
+        free_path = free_plain;
+    }
+}
+
+/**
+ * @brief mm_realloc Reallocates a block of memory
+ * @param bp The block pointer of the block to be reallocated
+ * @param size The size of the block to be reallocated
+ * @return The block pointer to the reallocated block
+ */
+void *mm_realloc(void *bp, size_t size)
+{
+    size_t oldsize;
+
+    LOCK();
+    oldsize = bp ? GET_SIZE(HDRP(bp)) : 0;                                                  //Before the block is freed or moved
+    bp = realloc_block(bp, size);
+    VERIFY();
+    EVENT(MM_EV_REALLOC, size, bp);
+    PUBLISH(MM_EV_REALLOC, size, bp ? GET_SIZE(HDRP(bp)) : 0, bp || !size ? oldsize : 0);   //A failed realloc leaves the old block live
+    UNLOCK();
+    return bp;
+}
+
+/**
+ * @brief mm_memalign Allocates a block whose payload is aligned to a power of two
+ * @param alignment The required alignment of the payload
+ * @param size The payload size
+ * @return The pointer to the start of the aligned block
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    void *bp;
+
+    LOCK();
+    bp = memalign_block(alignment, size);
+    VERIFY();
+    EVENT(MM_EV_MEMALIGN, size, bp);
+    PUBLISH(MM_EV_MEMALIGN, size, bp ? GET_SIZE(HDRP(bp)) : 0, 0);
+    UNLOCK();
+    return bp;
+}
+
+/**
+ * @brief malloc_block Allocates a block with atleast the specified size of payload
+ * @param size The payload size
+ * @param region LONG_LIVED to allocate from the long-lived region, 0 for the short-lived one
+ * @return The pointer to the start of the allocated block
+ */
+static void *malloc_block(size_t size, size_t region)
+{
+    size_t adjustedsize;                                                                    //The size of the adjusted block
+    char *bp;                                                                               //Stores the block pointer
+
+    if(size <= 0 || size > MAX_BLOCK - OVERHEAD){                                           //If requested size is 0 or too big for a header then ignore
+        return NULL;
+    }
+
+    adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                                      //Adjust block size to include overhead and alignment requirements
+
+    if(num_bins && !region){                                                                //If hot sizes get bins; they hold short-lived blocks only
+        count_size(adjustedsize);
+        if((bp = bin_pop(adjustedsize))){                                                   //Take a block of exactly this size without searching
+            return bp;
+        }
+    }
+
+    if((bp = find_fit(adjustedsize, region))){                                              //Traverse the free lists for a fit
+        place(bp, adjustedsize);                                                            //Place the block in the free list
+        return bp;
+    }
+
+    if(WILD_SIZE() < adjustedsize && num_bins && flush_bins()
+       && (bp = find_fit(adjustedsize, region))){                                           //Before growing the heap, see if binned blocks coalesce into a fit
+        place(bp, adjustedsize);
+        return bp;
+    }
+
+    return carve_wild(adjustedsize, region);                                                //Otherwise carve the block from the untouched top of the heap
+}
+
+/**
+ * @brief carve_wild Bumps a block off the front of the wilderness, growing the heap if it is too small
+ * @param size The adjusted size of the block
+ * @param region The region the block belongs to
+ * @return The pointer to the block, or NULL if the heap cannot grow
+ */
+static void *carve_wild(size_t size, size_t region){
+    char *bp;
+    size_t wildsize = WILD_SIZE();
+
+    if(wildsize < size){                                                                    //Get only the space the wilderness lacks, or grow_min
+        if(extend_heap(MAX(size - wildsize, grow_min) / WSIZE) == NULL){
+            return NULL;
+        }
+        wildsize = WILD_SIZE();
+    }
+
+    bp = to_ptr(state->wild);
+    if(wildsize - size >= OVERHEAD){                                                        //If the rest can stay a block, move the cursor past the new block
+        state->wild = to_off(bp + size);
+        PUT(HDRP(bp + size), PACK(wildsize - size, 0));
+        PUT(FTRP(bp + size), PACK(wildsize - size, 0));
+    }
+    else{                                                                                   //Otherwise take all of it
+        size = wildsize;
+        state->wild = 0;
+    }
+
+    PUT(HDRP(bp), PACK(size, 1 | region));                                                  //Put the header of the allocated block
+    PUT(FTRP(bp), PACK(size, 1 | region));                                                  //Put the footer of the allocated block
+    TOUCH(bp);
+    return bp;
+}
+
+/**
+ * @brief carve_aligned_wild Bumps a block off the wilderness big enough to hold an aligned block at its first aligned address
+ * @param alignment The required alignment of the payload
+ * @param size The size of the aligned block
+ * @return The pointer to the block, whose front and tail the caller gives back, or NULL if the heap cannot grow
+ */
+static void *carve_aligned_wild(size_t alignment, size_t size){
+    size_t lead = 0;                                                                        //The misaligned front of the wilderness
+    size_t need;                                                                            //The bytes the wilderness lacks
+
+    while(1){
+        if(state->wild){
+            lead = align_in_block(to_ptr(state->wild), alignment) - (char *)to_ptr(state->wild);
+            if(WILD_SIZE() >= lead + size){
+                break;
+            }
+            need = lead + size - WILD_SIZE();                                               //Growing keeps the start of the wilderness, so the front stays the same
+        }
+        else{
+            need = size + alignment + OVERHEAD;                                             //The new wilderness may start anywhere
+        }
+        if(extend_heap(MAX(need, grow_min) / WSIZE) == NULL){
+            return NULL;
+        }
+    }
+
+    return carve_wild(lead + size, 0);
+}
+
+/**
+ * @brief free_block Frees a block
+ * @param bp The block to be freed
+ */
+static void free_block(void *bp)
+{
+    if(!bp){                                                                                //If block pointer is null
+        return;                                                                             //return
+    }
+
+    if(predict_mode){                                                                       //If the block was sampled, its lifetime is now known
+        size_t slot = (to_off(bp) >> 3) & ((1 << SAMPLE_BITS) - 1);
+
+        if(samples[slot].off == to_off(bp)){
+            sample_died(slot, malloc_clock - samples[slot].born);
+        }
+    }
+
+    if(num_bins && !GET_REGION(HDRP(bp)) && bin_push(bp)){                                  //If its size has a bin with room, keep it there; long-lived blocks go back to their region
+        return;
+    }
+
+    release_block(bp);
+}
+
+/**
+ * @brief release_block Marks a block free and puts it back on its region's list
+ * @param bp The block to be freed
+ */
+static inline void release_block(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));                                                       //Get the total block size
+    size_t region = GET_REGION(HDRP(bp));                                                   //The block goes back to the region it came from
+
+    PUT(HDRP(bp), PACK(size, region));                                                      //Set the header as unallocated
+    PUT(FTRP(bp), PACK(size, region));                                                      //Set the footer as unallocated
+    coalesce(bp);                                                                           //Coalesce and add the block to the free list
+}
+
+/**
+ * @brief realloc_block Reallocates a block of memory
+ * @param bp The block pointer of the block to be reallocated
+ * @param size The size of the block to be reallocated
+ * @return The block pointer to the reallocated block
+ */
+static void *realloc_block(void *bp, size_t size)
+{
+    size_t oldsize;                                                                         //Holds the old size of the block
+    void *newbp;                                                                            //Holds the new block pointer
+    size_t adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                               //Calciulate the adjusted size
+
+    if(size <= 0){                                                                          //If size is less than 0
+        free_block(bp);                                                                     //Free the block
+        return 0;
+    }
+
+    if(size > MAX_BLOCK - OVERHEAD){                                                        //If the size is too big for a header the original block is left as it is
+        return 0;
+    }
+
+    if(bp == NULL){                                                                         //If old block pointer is null, then it is malloc
+        return malloc_block(size, 0);
+    }
+
+    oldsize = GET_SIZE(HDRP(bp));                                                           //Get the size of the old block
+
+    if(oldsize == adjustedsize){                                                            //If the size of the old block and requested size are same then return the old block pointer
+        return bp;
+    }
+
+    if(adjustedsize <= oldsize){                                                            //If the size needs to be decreased
+        trim_block(bp, adjustedsize);                                                       //Shrink the block
+        return bp;
+    }
+                                                                                            //If the block has to be expanded during reallocation
+    newbp = malloc_block(size, GET_REGION(HDRP(bp)));                                       //Allocate a new block in the same region
+    VERIFY_REGION(newbp, GET_REGION(HDRP(bp)));
+
+    if(!newbp){                                                                             //If realloc fails the original block is left as it is
+        return 0;
+    }
+
+    if(size < oldsize){
+        oldsize = size;
+    }
+
+    copy_payload(newbp, bp, oldsize);                                                       //Copy the old data to the new block
+    free_block(bp);                                                                         //Free the old block
+    return newbp;
+}
+
+/**
+ * @brief mm_calloc Allocates a zero-filled block for an array
+ * @param nmemb The number of elements
+ * @param size The size of each element
+ * @return The pointer to the start of the allocated block
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    size_t total = nmemb * size;                                                            //The payload size
+    void *bp;
+
+    if(size && total / size != nmemb){                                                      //If the multiplication overflowed
+        return NULL;                                                                        //return null
+    }
+
+    if((bp = mm_malloc(total))){                                                            //Allocate the block
+        memset(bp, 0, total);                                                               //Zero the payload
+    }
+
+    return bp;
+}
+
+/**
+ * @brief memalign_block Allocates a block whose payload is aligned to a power of two
+ * @param alignment The required alignment of the payload
+ * @param size The payload size
+ * @return The pointer to the start of the aligned block
+ */
+static void *memalign_block(size_t alignment, size_t size)
+{
+    char *bp;                                                                               //The block to carve from
+    char *alignedbp;                                                                        //The aligned block carved out of it
+    size_t adjustedsize;                                                                    //The size of the aligned block
+    size_t totalsize;                                                                       //The size of the block to carve from
+    size_t leadsize;                                                                        //The size of the misaligned front
+    size_t region;                                                                          //The region of the block to carve from
+
+    if(alignment & (alignment - 1)){                                                        //If alignment is not a power of two
+        return NULL;                                                                        //return null
+    }
+
+    if(alignment <= ALIGNMENT){                                                             //Every block is already this aligned
+        return malloc_block(size, 0);
+    }
+
+    if(size <= 0 || size > MAX_BLOCK - OVERHEAD - alignment){                               //If requested size is 0 or too big for a header then ignore
+        return NULL;
+    }
+
+    adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                                      //Adjust block size to include overhead and alignment requirements
+
+    if((bp = find_aligned_fit(alignment, adjustedsize))){                                   //If a free block has room at an aligned address
+        totalsize = GET_SIZE(HDRP(bp));
+        PUT(HDRP(bp), PACK(totalsize, 1 | GET_REGION(HDRP(bp))));                           //Take the whole block
+        PUT(FTRP(bp), PACK(totalsize, 1 | GET_REGION(HDRP(bp))));
+        remove_block(bp);
+    }
+    else if((bp = carve_aligned_wild(alignment, adjustedsize)) == NULL){                    //Otherwise carve it from the wilderness, from the aligned address on
+        return NULL;
+    }
+
+    alignedbp = align_in_block(bp, alignment);                                              //Find the aligned block inside it
+
+    if(alignedbp != bp){                                                                    //If the front has to be given back
+        totalsize = GET_SIZE(HDRP(bp));
+        leadsize = alignedbp - bp;
+        region = GET_REGION(HDRP(bp));                                                      //Both parts stay in the block's region
+        PUT(HDRP(alignedbp), PACK(totalsize - leadsize, 1 | region));                       //Put the header of the aligned block
+        PUT(FTRP(alignedbp), PACK(totalsize - leadsize, 1 | region));                       //Put the footer of the aligned block
+        PUT(HDRP(bp), PACK(leadsize, 1 | region));                                          //Shrink the front to its own block
+        PUT(FTRP(bp), PACK(leadsize, 1 | region));
+        free_block(bp);                                                                     //Free the front
+    }
+
+    trim_block(alignedbp, adjustedsize);                                                    //Free the unused tail
+    return alignedbp;
+}
+
+/**
+ * @brief align_in_block Finds where an aligned block can start inside a block
+ * @param bp The block pointer of the enclosing block
+ * @param alignment The required alignment of the payload
+ * @return The first aligned address that leaves a front big enough to be a block, or bp itself
+ */
+static char *align_in_block(char *bp, size_t alignment){
+    char *alignedbp = (char *)(((size_t)bp + alignment - 1) & ~(alignment - 1));            //The first aligned address in the payload
+
+    while(alignedbp != bp && alignedbp - bp < OVERHEAD){                                    //If the front is too small to become a free block
+        alignedbp += alignment;                                                             //move on to the next aligned address
+    }
+
+    return alignedbp;
+}
+
+/**
+ * @brief find_aligned_fit Finds a free block with room for an aligned block of a given size
+ * @param alignment The required alignment of the payload
+ * @param size The size of the aligned block
+ * @return The pointer to the free block, or NULL if no free block has room
+ */
+static void *find_aligned_fit(size_t alignment, size_t size){
+    void *bp;
+
+    for(bp = to_ptr(state->free_list); GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){      //Traverse the entire free list
+        if(align_in_block(bp, alignment) + size <= (char *)bp + GET_SIZE(HDRP(bp))){        //If the aligned block ends inside the free block
+            return bp;                                                                      //Return the block pointer
+        }
+    }
+
+    return NULL;                                                                            //If no fit is found return NULL
+}
+
+/**
+ * @brief mm_free_sized Frees a block whose payload size is known to the caller; with verify on, checks the size
+ * @param bp The block to be freed
+ * @param size The payload size it was allocated with
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    if(verify_every && bp && size > GET_SIZE(HDRP(bp)) - DSIZE){                            //The header holds the block size; a size it cannot hold is the caller's bug
+        verify_error("mm_free_sized of more bytes than the block holds", bp);
+        abort();
+    }
+
+    mm_free(bp);
+}
+
+/**
+ * @brief mm_halloc Allocates a movable block
+ * @param size The payload size
+ * @return The handle of the block, or 0 if out of memory
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    mm_handle_t h = 0;
+    void *bp;
+
+    if(size > MAX_BLOCK - OVERHEAD - DSIZE){                                                //If requested size is too big for a header then ignore
+        return 0;
+    }
+
+    LOCK();
+    if((state->free_hslot || grow_hslots() == 0) &&                                         //If every slot is in use, grow the handle table
+       (bp = malloc_block(size + DSIZE, 0)) != NULL){                                       //Allocate room for the payload and the handle
+        h = state->free_hslot;                                                              //Take the first unused slot
+        state->free_hslot = HSLOT(h).pins;
+        HSLOT(h).pins = 0;
+        mark_movable(bp, h);
+    }
+    PUBLISH(MM_EV_MALLOC, size, h ? GET_SIZE(HDRP(bp)) : 0, 0);
+    UNLOCK();
+    return h;
+}
+
+/**
+ * @brief mm_hfree Frees a movable block and its handle
+ * @param h The handle of the block
+ */
+void mm_hfree(mm_handle_t h)
+{
+    if(!h){                                                                                 //If handle is null
+        return;                                                                             //return
+    }
+
+    LOCK();
+    PUBLISH(MM_EV_FREE, 0, 0, GET_SIZE(HDRP(to_ptr(HSLOT(h).off))));
+    free_block(to_ptr(HSLOT(h).off));                                                       //Free the block, clearing the movable bit
+    HSLOT(h).off = 0;                                                                       //Put the slot back on the unused list
+    HSLOT(h).pins = state->free_hslot;
+    state->free_hslot = h;
+    UNLOCK();
+}
+
+/**
+ * @brief mm_hrealloc Resizes a movable block, which may move it
+ * @param h The handle of the block
+ * @param size The new payload size
+ * @return 0 if successful, -1 if the block is locked or there is no memory
+ */
+int mm_hrealloc(mm_handle_t h, size_t size)
+{
+    void *bp = NULL;
+    size_t oldsize;
+
+    if(size > MAX_BLOCK - OVERHEAD - DSIZE){                                                //If requested size is too big for a header then ignore
+        return -1;
+    }
+
+    LOCK();
+    oldsize = GET_SIZE(HDRP(to_ptr(HSLOT(h).off)));
+    if(!HSLOT(h).pins &&                                                                    //A locked block must stay where it is
+       (bp = realloc_block(to_ptr(HSLOT(h).off), size + DSIZE)) != NULL){                   //The handle is copied with the payload
+        mark_movable(bp, h);                                                                //realloc_block may have rewritten the header
+    }
+    PUBLISH(MM_EV_REALLOC, size, bp ? GET_SIZE(HDRP(bp)) : 0, bp ? oldsize : 0);
+    UNLOCK();
+    return bp ? 0 : -1;
+}
+
+/**
+ * @brief mm_hlock Locks a movable block in place
+ * @param h The handle of the block
+ * @return The payload address, valid until the matching mm_hunlock
+ */
+void *mm_hlock(mm_handle_t h)
+{
+    void *bp;
+
+    LOCK();
+    HSLOT(h).pins++;
+    bp = (char *)to_ptr(HSLOT(h).off) + DSIZE;                                              //The payload starts after the handle
+    UNLOCK();
+    return bp;
+}
+
+/**
+ * @brief mm_hunlock Undoes one mm_hlock, letting mm_compact move the block again
+ * @param h The handle of the block
+ */
+void mm_hunlock(mm_handle_t h)
+{
+    LOCK();
+    HSLOT(h).pins--;
+    UNLOCK();
+}
+
+/**
+ * @brief mm_compact Slides unlocked movable blocks down over the free space and trims the heap
+ * @return The number of bytes the heap shrank by
+ */
+size_t mm_compact(void)
+{
+    char *bp;                                                                               //The block being looked at
+    char *dst;                                                                              //Where the next movable block slides to
+    size_t size;                                                                            //The size of the block being looked at
+    size_t oldheapsize;                                                                     //The heap size before compacting
+    size_t shrunk;                                                                          //The number of bytes given back
+    size_t region;                                                                          //The region of the space from dst up to bp
+
+    LOCK();
+    flush_bins();                                                                           //Binned blocks would pin the heap, so free them first
+
+    oldheapsize = mem_heapsize();
+    dst = FIRST_BLKP();
+    region = GET_REGION(HDRP(dst));
+    for(bp = dst; (size = GET_SIZE(HDRP(bp))) > 0; bp += size){                             //Walk every block up to the epilogue
+        if(GET_REGION(HDRP(bp)) != region){                                                 //Blocks never slide into another region's memory
+            if(dst != bp){                                                                  //so the space left below a region change is a hole of the old region
+                PUT(HDRP(dst), PACK(bp - dst, region));
+                PUT(FTRP(dst), PACK(bp - dst, region));
+            }
+            dst = bp;
+            region = GET_REGION(HDRP(bp));
+        }
+
+        if(!GET_ALLOC(HDRP(bp))){                                                           //Free blocks become part of the space below the next block
+            continue;
+        }
+
+        if(GET_MOVABLE(HDRP(bp)) && !HSLOT(HINDEX(bp)).pins){                               //If the block can move, slide it down with its header and footer
+            if(dst != bp){
+                memmove(HDRP(dst), HDRP(bp), size);
+                if(HINDEX(dst) == 0){                                                       //If the handle table itself moved
+                    state->hslots = to_off(dst + DSIZE);
+                }
+                HSLOT(HINDEX(dst)).off = to_off(dst);                                       //Tell the handle where its block went
+            }
+            dst += size;
+            continue;
+        }
+
+        if(dst != bp){                                                                      //A block that cannot move leaves a hole below it, in its region
+            PUT(HDRP(dst), PACK(bp - dst, region));
+            PUT(FTRP(dst), PACK(bp - dst, region));
+        }
+        dst = bp + size;
+    }
+
+    if(dst != bp){                                                                          //Give the space above the last block back
+        PUT(HDRP(dst), PACK(0, 1));                                                         //Put the new epilogue header
+        mem_sbrk(dst - bp);
+    }
+
+    state->free_list = to_off(HEAP_LISTP() + DSIZE);                                        //Rebuild both free lists from the holes; both end at the prologue
+    state->long_list = state->free_list;                                                    //and insert_at_front puts each hole on its region's list
+    state->wild = 0;                                                                        //Any free space at the top goes on a list too
+    state->rover = 0;
+    num_touched = 0;                                                                        //The blocks noted before have moved
+    for(bp = FIRST_BLKP(); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if(!GET_ALLOC(HDRP(bp))){
+            insert_at_front(bp);
+        }
+    }
+
+    shrunk = oldheapsize - mem_heapsize();
+    PUBLISH(0, 0, 0, 0);                                                                    //Show the smaller heap
+    UNLOCK();
+    return shrunk;
+}
+
+/**
+ * @brief mm_get_stats Reports the allocator's counters since mm_init
+ * @param stats Where to copy them
+ */
+void mm_get_stats(mm_stats_t *stats)
+{
+    LOCK();
+    *stats = state->stats;
+    UNLOCK();
+}
+
+/**
+ * @brief count_size Counts a malloc of a size, gives hot sizes a bin and demotes cold ones
+ * @param size The adjusted block size
+ */
+static void count_size(size_t size){
+    struct mm_bin *bin;
+    struct mm_bin *unused = NULL;                                                           //A bin the size could get
+    size_t i, j;
+
+    if(sketch_count(size, 1) >= HOT_COUNT){                                                 //If the size is hot
+        for(i = 0; i < num_bins; i++){
+            bin = &state->bins[i];
+            if(bin->size == size){                                                          //and does not have a bin yet
+                break;
+            }
+            if(!bin->size && !unused){
+                unused = bin;
+            }
+        }
+        if(i == num_bins && unused){                                                        //give it one if there is one left
+            unused->size = size;
+            unused->count = 0;
+            unused->head = 0;
+            state->stats.bin_promotions++;
+        }
+    }
+
+    if(++sketch_ticks < SKETCH_PERIOD){
+        return;
+    }
+
+    sketch_ticks = 0;                                                                       //Halve the history so sizes cool
+    for(i = 0; i < SKETCH_ROWS; i++){
+        for(j = 0; j < (1 << SKETCH_BITS); j++){
+            sketch[i][j] >>= 1;
+        }
+    }
+
+    for(i = 0; i < MAX_BINS; i++){                                                          //Demote the bins of sizes that cooled
+        bin = &state->bins[i];
+        if(bin->size && sketch_count(bin->size, 0) < COLD_COUNT){
+            flush_bin(bin);
+            bin->size = 0;
+            state->stats.bin_demotions++;
+        }
+    }
+}
+
+/**
+ * @brief sketch_count Looks up, and optionally counts, a size in the count-min sketch
+ * @param size The adjusted block size
+ * @param add 1 to count a malloc of the size first, 0 to only look it up
+ * @return The smallest counter of the size, an upper bound on its recent mallocs
+ */
+static size_t sketch_count(size_t size, int add){
+    static const unsigned int mult[SKETCH_ROWS] = {0x9E3779B1u, 0x85EBCA6Bu};               //Multiplicative hashes, one per row
+    size_t min = (size_t)-1;
+    unsigned short *counter;
+    int i;
+
+    for(i = 0; i < SKETCH_ROWS; i++){
+        counter = &sketch[i][((unsigned int)(size >> 3) * mult[i]) >> (32 - SKETCH_BITS)];
+        if(add && *counter < 0xFFFF){
+            (*counter)++;
+        }
+        if(*counter < min){
+            min = *counter;
+        }
+    }
+
+    return min;
+}
+
+/**
+ * @brief bin_pop Takes a block out of the bin of a size
+ * @param size The adjusted block size
+ * @return The block, still marked allocated, or NULL if the size has no bin or it is empty
+ */
+static void *bin_pop(size_t size){
+    struct mm_bin *bin;
+    void *bp;
+    size_t i;
+
+    for(i = 0; i < MAX_BINS; i++){
+        bin = &state->bins[i];
+        if(bin->size == size && bin->head){                                                 //If the bin has a block, unlink the first
+            bp = to_ptr(bin->head);
+            bin->head = GETL(bp);
+            bin->count--;
+            state->stats.bin_hits++;
+            return bp;
+        }
+    }
+
+    state->stats.bin_misses++;
+    return NULL;
+}
+
+/**
+ * @brief bin_push Keeps a freed block in the bin of its size
+ * @param bp The block pointer
+ * @return 1 if the block went into a bin, 0 if it has to be freed for real
+ */
+static int bin_push(void *bp){
+    size_t size = GET_SIZE(HDRP(bp));
+    struct mm_bin *bin;
+    size_t i;
+
+    for(i = 0; i < MAX_BINS; i++){
+        bin = &state->bins[i];
+        if(bin->size == size && bin->count < BIN_MAX){
+            PUT(HDRP(bp), PACK(size, 1 | GET_REGION(HDRP(bp))));                            //Binned blocks are plain allocated blocks, never movable, in their region
+            PUT(FTRP(bp), PACK(size, 1 | GET_REGION(HDRP(bp))));
+            PUTL(bp, bin->head);                                                            //Link the block in front of the bin
+            bin->head = to_off(bp);
+            bin->count++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief flush_bin Frees every block of a bin for real
+ * @param bin The bin to empty
+ */
+static void flush_bin(struct mm_bin *bin){
+    void *bp;
+    size_t size = bin->size;
+
+    while(bin->head){
+        bp = to_ptr(bin->head);
+        bin->head = GETL(bp);
+        PUT(HDRP(bp), PACK(size, GET_REGION(HDRP(bp))));                                    //Set the header as unallocated, keeping the region
+        PUT(FTRP(bp), PACK(size, GET_REGION(HDRP(bp))));                                    //Set the footer as unallocated
+        coalesce(bp);                                                                       //Coalesce and add the block to the free list
+    }
+    bin->count = 0;
+}
+
+/**
+ * @brief predict_malloc Allocates a block in the region its predicted lifetime calls for
+ * @param size The payload size
+ * @param site The caller's return address, or NULL to predict from the size alone
+ * @return The pointer to the start of the allocated block
+ */
+static void *predict_malloc(size_t size, void *site){
+    size_t key = (size >> 3) ^ ((size_t)site >> 2);                                         //The size, and the caller if there is one
+    size_t cls = (unsigned int)key * 0x9E3779B1u >> (32 - PREDICT_BITS);                    //hashed to a lifetime class
+    size_t predicted = lifetimes[cls].longs > lifetimes[cls].shorts;                        //Long-lived if most sampled blocks of the class were
+    void *bp;
+
+    if((bp = malloc_block(size, predicted ? LONG_LIVED : 0)) == NULL){
+        return NULL;
+    }
+    VERIFY_REGION(bp, predicted ? LONG_LIVED : 0);
+
+    state->stats.predicted++;
+    state->stats.predicted_long += predicted;
+    if(++malloc_clock % SAMPLE_PERIOD == 0){                                                //Follow one block in SAMPLE_PERIOD to learn from
+        sample_block(bp, cls, predicted);
+    }
+
+    return bp;
+}
+
+/**
+ * @brief sample_block Follows a block to find out how long it lives
+ * @param bp The block pointer
+ * @param cls Its lifetime class
+ * @param predicted Whether it was predicted long-lived
+ */
+static void sample_block(void *bp, size_t cls, size_t predicted){
+    size_t slot = (to_off(bp) >> 3) & ((1 << SAMPLE_BITS) - 1);
+
+    if(samples[slot].off){                                                                  //If the slot is taken, the block in it counts as long-lived
+        if(malloc_clock - samples[slot].born < life_mallocs){                               //once it is old enough, and until then keeps the slot
+            return;
+        }
+        sample_died(slot, malloc_clock - samples[slot].born);
+    }
+
+    samples[slot].off = to_off(bp);
+    samples[slot].born = malloc_clock;
+    samples[slot].cls = cls;
+    samples[slot].predicted = predicted;
+}
+
+/**
+ * @brief sample_died Learns from the lifetime of a sampled block and stops following it
+ * @param slot Its slot in samples
+ * @param lived The mallocs it has lived for
+ */
+static void sample_died(size_t slot, size_t lived){
+    size_t cls = samples[slot].cls;
+    size_t was_long = lived >= life_mallocs;
+
+    if(lifetimes[cls].longs + lifetimes[cls].shorts >= LIFE_MAX){                           //Let old deaths count for less
+        lifetimes[cls].longs >>= 1;
+        lifetimes[cls].shorts >>= 1;
+    }
+    if(was_long){
+        lifetimes[cls].longs++;
+    }
+    else{
+        lifetimes[cls].shorts++;
+    }
+
+    state->stats.lifetime_samples++;
+    state->stats.lifetime_mispredicts += (samples[slot].predicted != was_long);
+    samples[slot].off = 0;
+}
+
+/**
+ * @brief flush_bins Frees the blocks of every bin for real, keeping the bins
+ * @return 1 if any block was freed, 0 if the bins were all empty
+ */
+static int flush_bins(void){
+    int flushed = 0;
+    size_t i;
+
+    for(i = 0; i < MAX_BINS; i++){
+        if(state->bins[i].head){
+            flush_bin(&state->bins[i]);
+            flushed = 1;
+        }
+    }
+
+    return flushed;
+}
+
+/**
+ * @brief copy_payload Copies a payload to a new block the way copy_mode says
+ * @param dst The new block
+ * @param src The old block
+ * @param n The bytes to copy
+ */
+static void copy_payload(void *dst, const void *src, size_t n){
+    switch(copy_mode){
+    case COPY_LIBC:
+        memcpy(dst, src, n);
+        break;
+    case COPY_VECTOR:
+        copy_vector(dst, src, n);
+        break;
+    case COPY_STREAM:
+        copy_stream(dst, src, n);
+        break;
+    default:
+        if(n >= stream_min){
+            copy_stream(dst, src, n);
+        }
+        else{
+            copy_vector(dst, src, n);
+        }
+        break;
+    }
+}
+
+/**
+ * @brief copy_vector Copies 64 bytes a step through SSE2 registers, storing to aligned addresses
+ * @param dst Where to copy to
+ * @param src Where to copy from
+ * @param n The bytes to copy
+ */
+static void copy_vector(char *dst, const char *src, size_t n){
+#ifdef __SSE2__
+    size_t head = -(size_t)dst & 15;                                                        //Bytes up to the first aligned store
+
+    if(n < 64 + head){                                                                      //Too short for the loop to pay
+        memcpy(dst, src, n);
+        return;
+    }
+
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+    for(; n >= 64; n -= 64, dst += 64, src += 64){
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+        _mm_store_si128((__m128i *)dst, a);
+        _mm_store_si128((__m128i *)(dst + 16), b);
+        _mm_store_si128((__m128i *)(dst + 32), c);
+        _mm_store_si128((__m128i *)(dst + 48), d);
+    }
+    memcpy(dst, src, n);                                                                    //The tail
+#else
+    memcpy(dst, src, n);
+#endif
+}
+
+/**
+ * @brief copy_stream Copies like copy_vector but with non-temporal stores, leaving the cache alone
+ * @param dst Where to copy to
+ * @param src Where to copy from
+ * @param n The bytes to copy
+ */
+static void copy_stream(char *dst, const char *src, size_t n){
+#ifdef __SSE2__
+    size_t head = -(size_t)dst & 15;                                                        //Bytes up to the first aligned store
 
-    if((bp = extend_heap(extendedsize / WSIZE)) == NULL){                                   //If unable to extend heap space
-        return NULL;                                                                        //return null
+    if(n < 64 + head){
+        memcpy(dst, src, n);
+        return;
     }
 
-    place(bp, adjustedsize);                                                                //Place the block in the newly extended space
-    return bp;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+    for(; n >= 64; n -= 64, dst += 64, src += 64){
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+    }
+    _mm_sfence();                                                                           //Order the streamed stores before the block is handed out
+    memcpy(dst, src, n);
+#else
+    memcpy(dst, src, n);
+#endif
 }
 
 /**
- * @brief mm_free Frees a block
- * @param bp The block to be freed
+ * @brief mark_movable Turns an allocated block into the movable block of a handle
+ * @param bp The block pointer of the allocated block
+ * @param h The handle the block belongs to
  */
-void mm_free(void *bp)
-{
-    if(!bp){                                                                                //If block pointer is null
-        return;                                                                             //return
-    }
-
-    size_t size = GET_SIZE(HDRP(bp));                                                       //Get the total block size
+static void mark_movable(void *bp, mm_handle_t h){
+    size_t size = GET_SIZE(HDRP(bp));
 
-    PUT(HDRP(bp), PACK(size, 0));                                                           //Set the header as unallocated
-    PUT(FTRP(bp), PACK(size, 0));                                                           //Set the footer as unallocated
-    coalesce(bp);                                                                           //Coalesce and add the block to the free list
+    PUT(HDRP(bp), PACK(size, 3));                                                           //Set the allocated and movable bits in the header
+    PUT(FTRP(bp), PACK(size, 3));                                                           //and in the footer
+    HINDEX(bp) = h;                                                                         //Point the block back at its handle
+    HSLOT(h).off = to_off(bp);
 }
 
 /**
- * @brief mm_realloc Reallocates a block of memory
- * @param bp The block pointer of the block to be reallocated
- * @param size The size of the block to be reallocated
- * @return The block pointer to the reallocated block
+ * @brief grow_hslots Doubles the handle table, which lives in a movable block of its own
+ * @return 0 if successful, -1 if out of memory
  */
-void *mm_realloc(void *bp, size_t size)
-{
-    size_t oldsize;                                                                         //Holds the old size of the block
-    void *newbp;                                                                            //Holds the new block pointer
-    size_t adjustedsize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                               //Calciulate the adjusted size
+static int grow_hslots(void){
+    size_t n = state->num_hslots ? 2 * state->num_hslots : HSLOTS;                          //The new number of slots
+    void *bp = state->hslots ? (char *)to_ptr(state->hslots) - DSIZE : NULL;                //The block of the old table
+    size_t h;
 
-    if(size <= 0){                                                                          //If size is less than 0
-        mm_free(bp);                                                                        //Free the block
-        return 0;
+    if((bp = realloc_block(bp, DSIZE + n * sizeof(struct mm_hslot))) == NULL){              //Move the table to a bigger block
+        return -1;
     }
 
-    if(bp == NULL){                                                                         //If old block pointer is null, then it is malloc
-        return mm_malloc(size);
+    state->hslots = to_off((char *)bp + DSIZE);
+    mark_movable(bp, 0);                                                                    //Slot 0 is the table's own handle
+    for(h = n - 1; h >= state->num_hslots && h > 0; h--){                                   //Chain the new slots in front of the unused list
+        HSLOT(h).off = 0;
+        HSLOT(h).pins = state->free_hslot;
+        state->free_hslot = h;
     }
-
-    oldsize = GET_SIZE(HDRP(bp));                                                           //Get the size of the old block
-
-    if(oldsize == adjustedsize){                                                            //If the size of the old block and requested size are same then return the old block pointer
-        return bp;
+    if(!state->num_hslots){                                                                 //The table's own slot is never locked
+        HSLOT(0).pins = 0;
     }
+    state->num_hslots = n;
+    return 0;
+}
 
-    if(adjustedsize <= oldsize){                                                            //If the size needs to be decreased
-        size = adjustedsize;                                                                //Shrink the block
+/**
+ * @brief trim_block Shrinks an allocated block, freeing the tail if it can form a block
+ * @param bp The block pointer of the allocated block
+ * @param size The adjusted size the block should be shrunk to
+ */
+static void trim_block(void *bp, size_t size){
+    size_t oldsize = GET_SIZE(HDRP(bp));                                                    //Get the size of the block
 
-        if(oldsize - size <= OVERHEAD){                                                     //If the new block cannot be formed
-            return bp;                                                                      //Return the old block pointer
-        }
-                                                                                            //If a new block can be formed
-        PUT(HDRP(bp), PACK(size, 1));                                                       //Update the size in the header of the reallocated block
-        PUT(FTRP(bp), PACK(size, 1));                                                       //Update the size in the header of the reallocated block
-        PUT(HDRP(NEXT_BLKP(bp)), PACK(oldsize - size, 1));                                  //Update the size in the header of the next block
-        mm_free(NEXT_BLKP(bp));                                                             //Free the next block
-        return bp;
+    if(oldsize - size <= OVERHEAD){                                                         //If the new block cannot be formed
+        return;                                                                             //Leave the block as it is
     }
-                                                                                            //If the block has to be expanded during reallocation
-    newbp = mm_malloc(size);                                                                //Allocate a new block
+                                                                                            //If a new block can be formed
+    size_t region = GET_REGION(HDRP(bp));                                                   //The tail stays in the block's region
 
-    if(!newbp){                                                                             //If realloc fails the original block is left as it is
-        return 0;
-    }
+    PUT(HDRP(bp), PACK(size, 1 | region));                                                  //Update the size in the header of the block
+    PUT(FTRP(bp), PACK(size, 1 | region));                                                  //Update the size in the footer of the block
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(oldsize - size, 1 | region));                             //Update the size in the header of the next block
+    free_block(NEXT_BLKP(bp));                                                              //Free the next block
+}
 
-    if(size < oldsize){
-        oldsize = size;
-    }
+/**
+ * @brief trim_wild Gives the wilderness back, moving the epilogue down to where it started
+ */
+static void trim_wild(void){
+    char *bp = to_ptr(state->wild);
+    size_t size = GET_SIZE(HDRP(bp));
+    int i, n = 0;
 
-    memcpy(newbp, bp, oldsize);                                                             //Copy the old data to the new block
-    mm_free(bp);                                                                            //Free the old block
-    return newbp;
+    PUT(HDRP(bp), PACK(0, 1));                                                              //Put the new epilogue header
+    mem_sbrk(-(intptr_t)size);
+    state->wild = 0;
+    for(i = 0; i < num_touched; i++){                                                       //The verifier must not look past the heap
+        if((char *)touched[i] < bp){
+            touched[n++] = touched[i];
+        }
+    }
+    num_touched = n;
 }
 
 /**
- * @brief extend_heap Extends the heap with free block
+ * @brief extend_heap Extends the heap, growing the wilderness
  * @param words The size to extend the heap by
  * @return The block pointer to the frst block in the newly acquired heap space
  */
@@ -227,19 +1915,32 @@ static void* extend_heap(size_t words){
 
     size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;                               //Allocate even number of  words to maintain alignment
 
-    if(size < OVERHEAD){
+    if(size < OVERHEAD && !state->wild){                                                    //A new wilderness must be able to stand as a block
         size = OVERHEAD;
     }
 
     if((long)(bp = mem_sbrk(size)) == -1){                                                  //If error in extending heap space return null
         return NULL;
     }
+    MM_TRACE(MM_TP_EXTEND_HEAP, extend_heap, size);
+    ev_flags |= MM_EVF_GREW;
+
+    if(state->wild){                                                                        //The new space joins the wilderness
+        bp = to_ptr(state->wild);
+        size += GET_SIZE(HDRP(bp));
+    }
+    else if(!GET_ALLOC(HDRP(bp) - WSIZE) && PREV_BLKP(bp) != bp){                           //or a free block below it becomes the wilderness
+        bp = PREV_BLKP(bp);
+        size += GET_SIZE(HDRP(bp));
+        remove_block(bp);
+    }
 
     PUT(HDRP(bp), PACK(size, 0));                                                           //Put the free block header
     PUT(FTRP(bp), PACK(size, 0));                                                           //Put the free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));                                                   //Put the new epilogue header
+    state->wild = to_off(bp);                                                               //Keep it off the free lists
 
-    return coalesce(bp);                                                                    //Coalesce if the previous block was free and add the block to the free list
+    return bp;
 }
 
 /**
@@ -248,46 +1949,79 @@ static void* extend_heap(size_t words){
  * @return The pointer to the coalesced block
  */
 static void *coalesce(void *bp){
-    size_t previous_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp;          //Stores whether the previous block is allocated or not
-    size_t next__alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));                                    //Stores whether the next block is allocated or not
+    size_t region = GET_REGION(HDRP(bp));                                                   //Blocks of other regions are treated as allocated
+    size_t previous_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp           //Stores whether the previous block is allocated or not
+                            || GET_REGION(FTRP(PREV_BLKP(bp))) != region;
+    size_t wild = to_off(NEXT_BLKP(bp)) == state->wild;                                     //Whether the next block is the wilderness, which is on no list and in no region
+    size_t next__alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)))                                     //Stores whether the next block is allocated or not
+                         || (GET_REGION(HDRP(NEXT_BLKP(bp))) != region && !wild);
     size_t size = GET_SIZE(HDRP(bp));                                                       //Stores the size of the block
 
     if(previous_alloc && !next__alloc){                                                     //Case 1: The block next to the current block is free
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));                                              //Add the size of the next block to the current block to make it a single block
-        remove_block(NEXT_BLKP(bp));                                                        //Remove the next block
-        PUT(HDRP(bp), PACK(size, 0));                                                       //Update the new block's header
-        PUT(FTRP(bp), PACK(size, 0));                                                       //Update the new block's footer
+        MM_TRACE(MM_TP_COALESCE1, coalesce1, size);
+        ev_flags |= MM_EVF_COALESCE1;
+        if(!wild){
+            remove_block(NEXT_BLKP(bp));                                                    //Remove the next block
+        }
+        PUT(HDRP(bp), PACK(size, region));                                                  //Update the new block's header
+        PUT(FTRP(bp), PACK(size, region));                                                  //Update the new block's footer
     }
 
     else if(!previous_alloc && next__alloc){                                                //Case 2: The block previous to the current block is free
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));                                              //Add the size of the previous block to the current bloxk to make it a single block
+        MM_TRACE(MM_TP_COALESCE2, coalesce2, size);
+        ev_flags |= MM_EVF_COALESCE2;
         bp = PREV_BLKP(bp);                                                                 //Update the block pointer to the previous block
         remove_block(bp);                                                                   //Remove the previous block
-        PUT(HDRP(bp), PACK(size, 0));                                                       //Update the new block's header
-        PUT(FTRP(bp), PACK(size, 0));                                                       //Update the new block's footer
+        PUT(HDRP(bp), PACK(size, region));                                                  //Update the new block's header
+        PUT(FTRP(bp), PACK(size, region));                                                  //Update the new block's footer
     }
 
     else if(!previous_alloc && !next__alloc){                                               //Case 3: The blocks to the either side of the current block are free
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));              //Add the size of previous and next blocks to the current block to make it single
+        MM_TRACE(MM_TP_COALESCE3, coalesce3, size);
+        ev_flags |= MM_EVF_COALESCE3;
         remove_block(PREV_BLKP(bp));                                                        //Remove the block previous to the current block
-        remove_block(NEXT_BLKP(bp));                                                        //Remove the block next to the current block
+        if(!wild){
+            remove_block(NEXT_BLKP(bp));                                                    //Remove the block next to the current block
+        }
         bp = PREV_BLKP(bp);                                                                 //Update the block pointer to the previous block
-        PUT(HDRP(bp), PACK(size, 0));                                                       //Update the new block's header
-        PUT(FTRP(bp), PACK(size, 0));                                                       //Update the new block's footer
+        PUT(HDRP(bp), PACK(size, region));                                                  //Update the new block's header
+        PUT(FTRP(bp), PACK(size, region));                                                  //Update the new block's footer
+    }
+    while(wild && PREV_BLKP(bp) != bp && !GET_ALLOC(FTRP(PREV_BLKP(bp)))){                  //Free blocks of the other region below the wilderness join it too
+        bp = PREV_BLKP(bp);
+        size += GET_SIZE(HDRP(bp));
+        remove_block(bp);
     }
-    insert_at_front(bp);                                                                    //Insert the block to the start of free list
+    TOUCH(bp);                                                                              //Blocks noted inside it are gone
+    if(wild){                                                                               //A block that reaches the top of the heap becomes the wilderness
+        state->wild = to_off(bp);
+        PUT(HDRP(bp), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0));
+        if(size > trim_min){                                                                //and is given back if it has grown too big
+            trim_wild();
+        }
+        return bp;
+    }
+
+    insert_at_front(bp);                                                                    //Insert the block to the start of its region's free list
     return bp;
 }
 
 /**
- * @brief insert_at_front Inserts a block at the front of the free list
+ * @brief insert_at_front Inserts a block at the front of the free list of its region
  * @param bp The pointer of the block to be added at the front of the free list
  */
 static void insert_at_front(void *bp){
-    NEXT_FREEP(bp) = free_listp;                                                            //Sets the next pointer to the start of the free list
-    PREV_FREEP(free_listp) = bp;                                                            //Sets the current's previous to the new block
-    PREV_FREEP(bp) = NULL;                                                                  //Set the previosu free pointer to NULL
-    free_listp = bp;                                                                        //Sets the start of the free list as the new block
+    size_t *list = GET_REGION(HDRP(bp)) ? &state->long_list : &state->free_list;            //The free list of the block's region
+    void *free_listp = to_ptr(*list);                                                       //The start of the free list
+
+    SET_NEXT_FREEP(bp, free_listp);                                                         //Sets the next pointer to the start of the free list
+    SET_PREV_FREEP(free_listp, bp);                                                         //Sets the current's previous to the new block
+    SET_PREV_FREEP(bp, NULL);                                                               //Set the previosu free pointer to NULL
+    *list = to_off(bp);                                                                     //Sets the start of the free list as the new block
 }
 
 /**
@@ -295,26 +2029,70 @@ static void insert_at_front(void *bp){
  * @param bp The pointer to the block to be removed from the free list
  */
 static void remove_block(void *bp){
+    if(state->rover == to_off(bp)){                                                         //If next fit would resume from this block
+        state->rover = GETL((void *)(bp) + DSIZE);                                          //resume from the one after it instead
+    }
+
     if(PREV_FREEP(bp)){                                                                     //If there is a previous block
-        NEXT_FREEP(PREV_FREEP(bp)) = NEXT_FREEP(bp);                                        //Set the next pointer of the previous block to next block
+        SET_NEXT_FREEP(PREV_FREEP(bp), NEXT_FREEP(bp));                                     //Set the next pointer of the previous block to next block
+    }
+
+    else if(state->free_list == to_off(bp)){                                                //If there is no previous block
+        state->free_list = to_off(NEXT_FREEP(bp));                                          //Set the free list to the next block
     }
 
-    else{                                                                                   //If there is no previous block
-        free_listp = NEXT_FREEP(bp);                                                        //Set the free list to the next block
+    else{                                                                                   //The same for the head of the long-lived list
+        state->long_list = to_off(NEXT_FREEP(bp));
     }
 
-    PREV_FREEP(NEXT_FREEP(bp)) = PREV_FREEP(bp);                                            //Set the previous block's pointer of the next block to the previous block
+    SET_PREV_FREEP(NEXT_FREEP(bp), PREV_FREEP(bp));                                         //Set the previous block's pointer of the next block to the previous block
 }
 
 /**
  * @brief find_fit Finds a fit for the block of a given size
  * @param size The size of the block to be fit
+ * @param region LONG_LIVED to search the long-lived region first, 0 to search the short-lived one first
  * @return The pointer to the block used for allocation
  */
-static void *find_fit(size_t size){
+static void *find_fit(size_t size, size_t region){
     void *bp;
 
-    for(bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){                    //Traverse the entire free list
+    MM_TRACE(MM_TP_FIND_FIT_ENTER, find_fit_enter, size);
+    if(region){                                                                             //Long-lived blocks come from their own region if they can
+        if(!(bp = find_first_fit(to_ptr(state->long_list), size))
+           && (bp = find_first_fit(to_ptr(state->free_list), size))){                       //or else claim a short-lived free block for it
+            remove_block(bp);
+            PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), LONG_LIVED));
+            PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), LONG_LIVED));
+            insert_at_front(bp);
+        }
+    }
+
+    else if(size >= large_min){                                                             //Large blocks are few, so the best fit is worth a full search
+        bp = find_tightest_fit(size, 0, 0);
+    }
+
+    else{
+        bp = fit_search(size);                                                              //The policy mm_config picked
+    }
+
+    if(!bp && !region){                                                                     //Short-lived blocks may borrow long-lived space
+        bp = find_first_fit(to_ptr(state->long_list), size);
+    }
+
+    MM_TRACE(MM_TP_FIND_FIT_EXIT, find_fit_exit, bp != NULL);
+    return bp;
+}
+
+/**
+ * @brief find_first_fit Finds the first fit on a free list
+ * @param bp The head of the free list
+ * @param size The size of the block to be fit
+ * @return The pointer to the block used for allocation
+ */
+static void *find_first_fit(void *bp, size_t size){
+    for(; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){                                   //Traverse the entire free list
+        ev_visits++;
         if(size <= GET_SIZE(HDRP(bp))){                                                     //If size fits in the available free block
             return bp;                                                                      //Return the block pointer
         }
@@ -323,6 +2101,87 @@ static void *find_fit(size_t size){
     return NULL;                                                                            //If no fit is found return NULL
 }
 
+/**
+ * @brief find_head_fit Finds the first fit on the short-lived free list: the first fit policy
+ * @param size The size of the block to be fit
+ * @return The pointer to the block used for allocation
+ */
+static void *find_head_fit(size_t size){
+    return find_first_fit(to_ptr(state->free_list), size);
+}
+
+/**
+ * @brief find_next_fit Finds a fit from the rover on, wrapping around to the head once
+ * @param size The size of the block to be fit
+ * @return The pointer to the block used for allocation, also left in the rover
+ */
+static void *find_next_fit(size_t size){
+    void *rover = state->rover ? to_ptr(state->rover) : to_ptr(state->free_list);           //Where the last search stopped
+    void *bp;
+
+    for(bp = rover; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){                         //Traverse the free list from the rover to its end
+        ev_visits++;
+        if(size <= GET_SIZE(HDRP(bp))){
+            state->rover = to_off(bp);
+            return bp;
+        }
+    }
+
+    for(bp = to_ptr(state->free_list); bp != rover && GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){ //Then from its head up to the rover
+        ev_visits++;
+        if(size <= GET_SIZE(HDRP(bp))){
+            state->rover = to_off(bp);
+            return bp;
+        }
+    }
+
+    return NULL;                                                                            //If no fit is found return NULL
+}
+
+/**
+ * @brief find_good_fit Finds the tightest of the first good_k fits, stopping early at a close one
+ * @param size The size of the block to be fit
+ * @return The pointer to the block used for allocation
+ */
+static void *find_good_fit(size_t size){
+    return find_tightest_fit(size, good_k, size * good_x / 100);
+}
+
+/**
+ * @brief find_tightest_fit Finds the tightest of the first k fits on the short-lived free list
+ * @param size The size of the block to be fit
+ * @param k The fits to look at, 0 for all of them
+ * @param slack The waste of a fit that ends the search at once
+ * @return The pointer to the block used for allocation
+ */
+static void *find_tightest_fit(size_t size, size_t k, size_t slack){
+    void *bp;
+    void *best = NULL;                                                                      //The tightest fit so far
+    size_t bestsize = 0;                                                                    //and its size
+    size_t seen = 0;                                                                        //The number of fits looked at
+
+    for(bp = to_ptr(state->free_list); GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){      //Traverse the free list
+        size_t bsize = GET_SIZE(HDRP(bp));
+
+        ev_visits++;
+        if(size > bsize){                                                                   //If size does not fit, it does not count
+            continue;
+        }
+        if(bsize - size <= slack){                                                          //If the fit is close enough, take it
+            return bp;
+        }
+        if(!best || bsize < bestsize){
+            best = bp;
+            bestsize = bsize;
+        }
+        if(++seen == k){                                                                    //If enough fits have been seen
+            break;
+        }
+    }
+
+    return best;                                                                            //The tightest fit, or NULL if no fit is found
+}
+
 /**
  * @brief place Place a block of specified size to start of free block
  * @param bp The block pointer to the free block
@@ -330,21 +2189,26 @@ static void *find_fit(size_t size){
  */
 static void place(void *bp, size_t size){
     size_t totalsize = GET_SIZE(HDRP(bp));                                                  //Get the total size of thefree block
+    size_t region = GET_REGION(HDRP(bp));                                                   //Both parts stay in the free block's region
 
-    if((totalsize - size) >= OVERHEAD){                                                     //If the difference between the total size and requested size is more than overhead, split the block
-        PUT(HDRP(bp), PACK(size, 1));                                                       //Put the header of the allocated block
-        PUT(FTRP(bp), PACK(size, 1));                                                       //Put the footer of the allocated block
+    if((totalsize - size) >= split_min){                                                    //If the difference between the total size and requested size is big enough, split the block
+        MM_TRACE(MM_TP_SPLIT, split, totalsize - size);
+        ev_flags |= MM_EVF_SPLIT;
+        PUT(HDRP(bp), PACK(size, 1 | region));                                              //Put the header of the allocated block
+        PUT(FTRP(bp), PACK(size, 1 | region));                                              //Put the footer of the allocated block
         remove_block(bp);                                                                   //Remove the allocated block
+        TOUCH(bp);
         bp = NEXT_BLKP(bp);                                                                 //The block pointer of the free block created by the partition
-        PUT(HDRP(bp), PACK(totalsize - size, 0));                                           //Put the header of the new unallocated block
-        PUT(FTRP(bp), PACK(totalsize - size, 0));                                           //Put the footer of the new unallocated block
+        PUT(HDRP(bp), PACK(totalsize - size, region));                                      //Put the header of the new unallocated block
+        PUT(FTRP(bp), PACK(totalsize - size, region));                                      //Put the footer of the new unallocated block
         coalesce(bp);                                                                       //Coalesce the new free block with the adjacent free blocks
     }
 
     else{                                                                                   //If the remaining space is not enough for a free block then donot split the block
-        PUT(HDRP(bp), PACK(totalsize, 1));                                                  //Put the header of the block
-        PUT(FTRP(bp), PACK(totalsize, 1));                                                  //Put the footer of the block
+        PUT(HDRP(bp), PACK(totalsize, 1 | region));                                         //Put the header of the block
+        PUT(FTRP(bp), PACK(totalsize, 1 | region));                                         //Put the footer of the block
         remove_block(bp);                                                                   //Remove the allocated block
+        TOUCH(bp);
     }
 }
 
@@ -353,7 +2217,8 @@ static void place(void *bp, size_t size){
  * @return Returns 0 if consistent, -1 is inconsistent
  */
 int mm_check(void){
-    void *bp = heap_listp;                                                                  //Points to the first block in the heap
+    char *heap_listp = HEAP_LISTP();                                                        //Points to the first block in the heap
+    void *bp = heap_listp;
     printf("Heap (%p): \n", heap_listp);                                                    //Print the address of the heap
 
     if((GET_SIZE(HDRP(heap_listp)) != OVERHEAD) || !GET_ALLOC(HDRP(heap_listp))){           //If the first block's header's size or allocated bit is wrong
@@ -364,7 +2229,7 @@ int mm_check(void){
         return -1;
     }
 
-    for(bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){                    //Check all the blocks of free list for consistency
+    for(bp = to_ptr(state->free_list); GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)){      //Check all the blocks of free list for consistency
          if(check_block(bp) == -1){                                                         //If inconsistency
                 return -1;                                                                  //Throw error
          }
@@ -401,3 +2266,308 @@ static int check_block(void *bp){
 
     return 0;                                                                               //Block is consistent
 }
+
+/**
+ * @brief mm_verify Walks the whole heap and both free lists and checks that they agree
+ * @return Returns 0 if consistent, -1 if inconsistent
+ */
+int mm_verify(void){
+    int result;
+
+    LOCK();
+    result = verify_heap();
+    UNLOCK();
+    return result;
+}
+
+/**
+ * @brief note_touched Notes a block for verify_op to check, forgetting blocks noted inside it
+ * @param bp The block pointer
+ */
+static void note_touched(void *bp){
+    char *end = (char *)bp + GET_SIZE(HDRP(bp));
+    int i, n = 0;
+
+    for(i = 0; i < num_touched; i++){                                                       //Blocks coalesced into this one no longer exist
+        if(touched[i] != bp && ((char *)touched[i] <= (char *)bp || (char *)touched[i] >= end)){
+            touched[n++] = touched[i];
+        }
+    }
+    num_touched = n;
+    if(num_touched < VERIFY_TOUCHED){
+        touched[num_touched++] = bp;
+    }
+}
+
+/**
+ * @brief verify_op Checks the blocks the operation touched, and walks the heap every verify_every operations
+ */
+static void verify_op(void){
+    int i, n = num_touched;
+
+    num_touched = 0;
+    for(i = 0; i < n; i++){
+        if(verify_block(touched[i]) == -1){
+            abort();                                                                        //The heap is corrupt; stop at the operation that broke it
+        }
+    }
+    state->stats.verify_blocks += n;
+
+    if(++verify_ops >= verify_every){
+        verify_ops = 0;
+        state->stats.verify_walks++;
+        if(verify_heap() == -1){
+            abort();
+        }
+    }
+}
+
+/**
+ * @brief verify_region Checks that a long-lived request got a long-lived block; short-lived ones may borrow either
+ * @param bp The block returned, or NULL
+ * @param region The region asked for
+ */
+static void verify_region(void *bp, size_t region){
+    if(bp && region && !GET_REGION(HDRP(bp))){
+        verify_error("long-lived request got a short-lived block", bp);
+        abort();
+    }
+}
+
+/**
+ * @brief verify_error Reports a failed check
+ * @param msg What is wrong
+ * @param bp The block it is wrong with
+ * @return Returns -1
+ */
+static int verify_error(const char *msg, void *bp){
+    printf("mm_verify: %s at %p\n", msg, bp);
+    fflush(stdout);                                                                         //verify_op aborts next
+    return -1;
+}
+
+/**
+ * @brief verify_block Checks a block against its neighbours and, if it is free, its free-list links
+ * @param bp The block pointer
+ * @return Returns 0 if consistent, -1 if inconsistent
+ */
+static int verify_block(void *bp){
+    char *lo = FIRST_BLKP();                                                                //The lowest block pointer there can be
+    char *hi = (char *)mem_heap_hi() + 1;                                                   //The epilogue's block pointer
+    size_t size = GET_SIZE(HDRP(bp));
+    void *next, *prev, *link;
+
+    if((char *)bp < lo || (char *)bp >= hi || (size_t)bp % ALIGNMENT){
+        return verify_error("block pointer outside the heap or misaligned", bp);
+    }
+    if(size < OVERHEAD || size % ALIGNMENT || (char *)bp + size > hi){
+        return verify_error("bad block size", bp);
+    }
+    if(GET(HDRP(bp)) != GET(FTRP(bp))){
+        return verify_error("header and footer differ", bp);
+    }
+
+    next = NEXT_BLKP(bp);                                                                   //The block above, or the epilogue
+    if(GET_SIZE(HDRP(next)) == 0){
+        if((char *)next != hi || !GET_ALLOC(HDRP(next))){
+            return verify_error("bad epilogue", next);
+        }
+    }
+    else if((char *)next + GET_SIZE(HDRP(next)) > hi || GET(HDRP(next)) != GET(FTRP(next))){
+        return verify_error("bad block above", next);
+    }
+
+    prev = PREV_BLKP(bp);                                                                   //The block below, or bp itself for the first block
+    if(prev != bp && ((char *)prev < lo || GET(HDRP(prev)) != GET(FTRP(prev)))){
+        return verify_error("bad block below", bp);
+    }
+
+    if(GET_ALLOC(HDRP(bp))){
+        if(to_off(bp) == state->wild){
+            return verify_error("the wilderness is allocated", bp);
+        }
+        return 0;
+    }
+
+    if(prev != bp && !GET_ALLOC(HDRP(prev))
+       && (GET_REGION(HDRP(prev)) == GET_REGION(HDRP(bp)) || to_off(bp) == state->wild)){   //Only blocks of different regions stay apart, and none below the wilderness
+        return verify_error("free block below left uncoalesced", bp);
+    }
+    if(GET_SIZE(HDRP(next)) && !GET_ALLOC(HDRP(next))
+       && (GET_REGION(HDRP(next)) == GET_REGION(HDRP(bp)) || to_off(next) == state->wild)){
+        return verify_error("free block above left uncoalesced", bp);
+    }
+
+    if(to_off(bp) == state->wild){                                                          //The wilderness is on no list
+        if(GET_SIZE(HDRP(next))){
+            return verify_error("the wilderness is not the top block", bp);
+        }
+        return 0;
+    }
+
+    link = PREV_FREEP(bp);
+    if(link == NULL){
+        if(to_off(bp) != (GET_REGION(HDRP(bp)) ? state->long_list : state->free_list)){
+            return verify_error("free block with no predecessor is not at the head of its list", bp);
+        }
+    }
+    else if((char *)link < lo || (char *)link >= hi || NEXT_FREEP(link) != bp){
+        return verify_error("bad previous free-list link", bp);
+    }
+
+    link = NEXT_FREEP(bp);
+    if(link != SENTINEL() && ((char *)link < lo || (char *)link >= hi || PREV_FREEP(link) != bp)){
+        return verify_error("bad next free-list link", bp);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief verify_heap Checks every block, and that the free lists hold exactly the free blocks
+ * @return Returns 0 if consistent, -1 if inconsistent
+ */
+static int verify_heap(void){
+    size_t lists[2] = {state->free_list, state->long_list};
+    size_t free = 0, listed = 0;                                                            //Free blocks in the heap and on the lists
+    void *bp;
+    int i;
+
+    for(bp = FIRST_BLKP(); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if(verify_block(bp) == -1){
+            return -1;
+        }
+        if(!GET_ALLOC(HDRP(bp)) && to_off(bp) != state->wild){
+            free++;
+        }
+    }
+    if((char *)bp != (char *)mem_heap_hi() + 1){
+        return verify_error("the heap does not end at the epilogue", bp);
+    }
+    if(state->wild && (GET_ALLOC(HDRP(to_ptr(state->wild))) || NEXT_BLKP(to_ptr(state->wild)) != bp)){
+        return verify_error("the wilderness is not the free top block", to_ptr(state->wild));
+    }
+
+    for(i = 0; i < 2; i++){
+        for(bp = to_ptr(lists[i]); bp != SENTINEL(); bp = NEXT_FREEP(bp)){
+            if(++listed > free || bp == NULL || GET_ALLOC(HDRP(bp))
+               || GET_REGION(HDRP(bp)) != (i ? LONG_LIVED : 0)){
+                return verify_error("free list holds a block it should not", bp);      //Allocated, of the other region, or seen before
+            }
+        }
+    }
+    if(listed != free){
+        return verify_error("free blocks missing from the free lists", NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief record_event Appends an operation to the calling thread's event ring and starts counting the next
+ * @param op MM_EV_*
+ * @param size The request, or the size of the block being freed
+ * @param bp The block returned or freed, or NULL: a failure unless size is 0
+ */
+static inline void record_event(int op, size_t size, void *bp){
+    mm_event_record(op, size, to_off(bp), ev_flags | (bp || !size ? 0 : MM_EVF_FAILED), ev_visits);
+    ev_flags = 0;
+    ev_visits = 0;
+}
+
+/**
+ * @brief publish Counts an operation in stat_batch, and moves the batch to the stats page every STAT_BATCH operations
+ * @param op MM_EV_*, or 0 for none: only the heap size changed, which is shown at once
+ * @param size The request
+ * @param added The size of the block handed out, or 0
+ * @param removed The size of the block taken back, or 0
+ */
+static inline void publish(int op, size_t size, size_t added, size_t removed){
+    if(op == MM_EV_FREE){
+        stat_batch.frees++;
+    }
+    else if(op == MM_EV_REALLOC){
+        stat_batch.reallocs++;
+    }
+    else if(op){
+        stat_batch.mallocs++;
+        if(added){                                                                          //Counted by request size, the last class for the rest
+            stat_batch.class_mallocs[size - 1 < MM_MAX_CLASS ? mm_size_class(size) : MM_NUM_CLASSES]++;
+        }
+    }
+    stat_batch.live_bytes += added - removed;
+    if(++stat_batch.ops >= STAT_BATCH || !op){
+        flush_stats();
+    }
+}
+
+/**
+ * @brief flush_stats Adds stat_batch to the stats page, as the seqlock's one writer, and empties it
+ */
+static void flush_stats(void){
+    mm_statpage_t *page = statpage;
+    int c;
+
+    mm_statpage_begin(page);
+    page->mallocs += stat_batch.mallocs;
+    page->frees += stat_batch.frees;
+    page->reallocs += stat_batch.reallocs;
+    page->live_bytes += stat_batch.live_bytes;
+    for(c = 0; c < MM_STAT_CLASSES; c++){
+        page->class_mallocs[c] += stat_batch.class_mallocs[c];
+    }
+    page->heap_bytes = mem_heapsize();
+    page->lock_waits = state->stats.lock_waits;
+    mm_statpage_end(page);
+    memset(&stat_batch, 0, sizeof(stat_batch));
+}
+
+/**
+ * @brief close_statpage Stops publishing statistics and removes the shared page
+ */
+static void close_statpage(void){
+    if(statpage){
+        mm_statpage_close(statpage, statpage_name);
+        statpage = NULL;
+    }
+    memset(&stat_batch, 0, sizeof(stat_batch));                                             //A page opened later starts from nothing
+}
+
+/**
+ * @brief drop_local_policies Turns off bins, lifetime prediction and verify, which keep history in process statics
+ */
+static void drop_local_policies(void){
+    num_bins = 0;
+    predict_mode = PREDICT_OFF;
+    verify_every = 0;
+    verify_ops = 0;
+    num_touched = 0;
+}
+
+/**
+ * @brief lock_heap Takes the heap lock, counting the calls that had to wait for it
+ */
+static void lock_heap(void){
+    if(pthread_mutex_trylock(&state->lock) != 0){
+        pthread_mutex_lock(&state->lock);
+        state->stats.lock_waits++;                                                          //Counted once the lock is held
+    }
+}
+
+/**
+ * @brief to_ptr Turns a heap offset into an address
+ * @param off The offset from the start of the heap, or 0
+ * @return The address, or NULL if off is 0
+ */
+static inline void *to_ptr(size_t off){
+    return off ? (char *)state + off : NULL;
+}
+
+/**
+ * @brief to_off Turns an address in the heap into a heap offset
+ * @param p The address, or NULL
+ * @return The offset from the start of the heap, or 0 if p is NULL
+ */
+static inline size_t to_off(void *p){
+    return p ? (size_t)((char *)p - (char *)state) : 0;
+}
@@ -1,9 +1,231 @@
 #include <stdio.h>
+#include "sizeclass.h"
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *bp);
 extern void *mm_realloc(void *bp, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void mm_free_sized(void *bp, size_t size);
+
+/* 
+ * Lifetime hints. Blocks from mm_malloc_hint(size, MM_LONG_LIVED) are
+ * kept in a region of their own, so that short-lived blocks freed
+ * around them can coalesce. MM_SHORT_LIVED is the same as mm_malloc.
+ */
+#define MM_SHORT_LIVED 1
+#define MM_LONG_LIVED  2
+
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/* 
+ * Allocator options as comma-separated name=value pairs. Returns -1 on 
+ * an unknown option or value. Options:
+ *     fit=first|next|good  search the free list from its head, resume
+ *                     where the previous search stopped, or take the 
+ *                     tightest of the first k fits
+ *     k=<n>           fits good fit looks at, 0 for all (best fit)
+ *     x=<percent>     good fit stops at a fit that wastes no more than
+ *                     this percent of the request
+ *     bins=<n>        give up to n (at most 8) hot request sizes an
+ *                     exact-size bin; 0, the default, turns bins off.
+ *                     Set it before mm_init.
+ *     predict=off|size|site  let mm_malloc put blocks it predicts to be
+ *                     long-lived in the region of mm_malloc_hint, going 
+ *                     by the lifetimes of sampled blocks of the same
+ *                     size, or of the same size and caller
+ *     life=<n>        blocks that outlive n mallocs (default 256)
+ *                     count as long-lived
+ *     copy=auto|libc|vector|stream  how mm_realloc copies a block it
+ *                     moves: the default switches from an SSE2 loop to
+ *                     non-temporal stores at stream bytes; the others
+ *                     use memcpy, or one of the two loops, for all sizes
+ *     stream=<bytes>  where copy=auto starts streaming (default 1 MB)
+ *     verify=<n>      check the blocks each malloc, free, realloc and 
+ *                     memalign touches, and the whole heap every n of 
+ *                     them, the size passed to mm_free_sized, and that
+ *                     long-lived requests get long-lived blocks; abort
+ *                     on the first inconsistency. 0, the default, turns
+ *                     checking off
+ *     events=<n>      keep each thread's last n operations (n a power
+ *                     of two) for mm_events_dump in events.h; 0, the
+ *                     default, records nothing
+ *     stats=<name>    keep live statistics in the shared memory object
+ *                     /<name> for mmstat (see statpage.h); an empty
+ *                     name stops
+ *     chunk=<bytes>   the wilderness mm_init starts the heap with
+ *     grow=<bytes>    the least the heap grows by when it must (default 
+ *                     0: only what the request lacks)
+ *     split=<bytes>   the smallest remainder a fit is split to leave 
+ *                     free (default, and at least, the 24-byte block)
+ *     trim=<bytes>    give the free space at the top of the heap back 
+ *                     once it is larger than this; 0, the default, 
+ *                     never does
+ *     large=<bytes>   search the whole free list for the best fit for 
+ *                     blocks of at least this size, whatever the fit 
+ *                     policy; 0, the default, turns it off
+ *     tcache=<n>      blocks each thread-cache class keeps, up to 
+ *                     MM_TCACHE_MAX (the default); 0 turns caching off
+ *
+ * mm_init also applies the options in the MM_CONFIG environment
+ * variable, after any set before, and fails if they do not parse.
+ */
+extern int mm_config(const char *opts);
+
+/* Checks the whole heap now; returns -1 and prints why if it is corrupt */
+extern int mm_verify(void);
+
+/* Counters kept by the allocator since mm_init */
+typedef struct {
+    long long bin_hits;       /* mallocs served from an exact-size bin */
+    long long bin_misses;     /* mallocs that had to search, with bins on */
+    long long bin_promotions; /* sizes that got a bin */
+    long long bin_demotions;  /* bins taken back from sizes that cooled */
+    long long predicted;      /* mallocs whose lifetime was predicted */
+    long long predicted_long; /* ... and that were put in the long-lived region */
+    long long lifetime_samples;    /* sampled blocks whose lifetime is known */
+    long long lifetime_mispredicts; /* ... and that were predicted wrongly */
+    long long verify_blocks;  /* blocks checked after the operations that touched them */
+    long long verify_walks;   /* full walks of the heap */
+    long long lock_waits;     /* calls that found the shared heap lock taken */
+} mm_stats_t;
+
+extern void mm_get_stats(mm_stats_t *stats);
+
+/* 
+ * Persistent heaps. mm_attach picks up the heap that memlib maps from
+ * a file (see mem_init_file) instead of starting a new one with 
+ * mm_init. The root is a block to start from after attaching; other
+ * blocks should refer to each other by offset, not by address.
+ */
+extern int mm_attach(void);
+extern void mm_set_root(void *bp);
+extern void *mm_get_root(void);
+
+/* 
+ * Shared heaps. After mm_share, every process that maps the heap 
+ * (see mem_init_shared) may call the functions above concurrently; 
+ * they serialize on a process-shared lock kept in the heap. Blocks
+ * are passed between processes as offsets from mem_heap_lo().
+ * Bins, lifetime prediction and verify learn from history each process
+ * keeps to itself, so mm_share (and mm_attach of a shared heap) turns
+ * them off and mm_config fails to turn them on for a shared heap;
+ * mm_verify still checks the whole heap on demand.
+ */
+extern int mm_share(void);
+
+/* 
+ * Movable blocks. A handle stays valid for the life of its block, but
+ * the block itself may be moved by mm_compact unless it is locked.
+ * Payload addresses from mm_hlock are valid until the matching 
+ * mm_hunlock. mm_hrealloc fails on a locked block. Handle 0 is never
+ * returned by a successful mm_halloc.
+ */
+typedef size_t mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t h);
+extern int mm_hrealloc(mm_handle_t h, size_t size);
+extern void *mm_hlock(mm_handle_t h);
+extern void mm_hunlock(mm_handle_t h);
+extern size_t mm_compact(void);
+
+/* 
+ * Bytes of header and footer that mm_malloc adds to every block. A caller
+ * that asks for payloads of (2^k - MM_BLOCK_OVERHEAD) bytes gets blocks
+ * that pack back to back at 2^k-aligned addresses.
+ */
+#define MM_BLOCK_OVERHEAD 8
+
+/* 
+ * Thread caches. mm_malloc_fast and mm_free_fast are inline and keep
+ * freed blocks of up to MM_MAX_CLASS bytes in a per-thread cache, one
+ * LIFO list per size class, so that the common small malloc and free
+ * are a few instructions and no call. They fall back to mm_malloc and
+ * mm_free when the cache is empty or full. Blocks from either pair may
+ * be freed with either pair. mm_tcache_flush frees the calling thread's
+ * cached blocks; call it before a thread exits. mm_init empties the
+ * calling thread's cache.
+ *
+ * The classes come from sizeclass.h, which make generates with
+ * gensizeclass: 16 bytes apart up to 128, then four per power of two.
+ */
+#define MM_TCACHE_MAX 32      /* most blocks a class may hold before frees go through */
+
+extern unsigned int mm_tcache_max;  /* blocks it does hold, mm_config "tcache" */
+
+typedef struct {
+    void *head[MM_NUM_CLASSES];          /* first cached block, linked through its payload */
+    unsigned int count[MM_NUM_CLASSES];  /* blocks cached */
+} mm_tcache_t;
+
+extern __thread mm_tcache_t mm_tcache;
+
+extern void *mm_tcache_malloc(size_t size);
+extern void mm_tcache_flush(void);
+
+/*
+ * mm_size_class - The smallest class that holds size bytes; MM_NUM_CLASSES
+ *     or more for sizes above MM_MAX_CLASS. Small sizes index the table;
+ *     larger ones take the class from the position of their highest bit
+ *     and the bits just below it. Both are computed and one is selected,
+ *     so there is no branch to mispredict on a mix of sizes.
+ */
+static inline size_t mm_size_class(size_t size)
+{
+    size_t x = size - 1;
+    size_t k = 63 - __builtin_clzl(x | MM_LOOKUP_MAX);  /* at least MM_LG_LOOKUP_MAX */
+    size_t i = (size + 15) >> 4;
+    size_t small, large;
+
+    i = size <= MM_LOOKUP_MAX ? i : 0;  /* keeps the table load in bounds */
+    small = mm_class_lookup[i];
+    large = MM_LARGE_BASE + 
+	((k - MM_LG_LOOKUP_MAX) << MM_LG_CLASSES_PER_DOUBLING) +
+	((x >> (k - MM_LG_CLASSES_PER_DOUBLING)) & 
+	 ((1 << MM_LG_CLASSES_PER_DOUBLING) - 1));
+    return size <= MM_LOOKUP_MAX ? small : large;
+}
+
+static inline void *mm_malloc_fast(size_t size)
+{
+    size_t c = mm_size_class(size);
+    void *bp;
+
+    /* A size of 0 wraps and goes slow */
+    if (size - 1 < MM_MAX_CLASS && (bp = mm_tcache.head[c]) != NULL) {
+	mm_tcache.head[c] = *(void **)bp;
+	mm_tcache.count[c]--;
+	return bp;
+    }
+    return mm_tcache_malloc(size);
+}
+
+static inline void mm_free_fast(void *bp)
+{
+    size_t cap, c;
+
+    if (bp == NULL)
+	return;
+
+    /* The largest class whose requests the payload can hold, from the 
+       size in the block's header word */
+    cap = (*(unsigned int *)((char *)bp - 4) & ~0x7) - MM_BLOCK_OVERHEAD;
+    if (cap > MM_MAX_CLASS) {
+	mm_free(bp);
+	return;
+    }
+    c = mm_size_class(cap);
+    c -= mm_class_size[c] > cap;
+    if (mm_tcache.count[c] < mm_tcache_max) {
+	*(void **)bp = mm_tcache.head[c];
+	mm_tcache.head[c] = bp;
+	mm_tcache.count[c]++;
+	return;
+    }
+    mm_free(bp);
+}
 
 
 /* 
@@ -0,0 +1,154 @@
+/*
+ * mmevents.c - Decodes a dump of the allocator's event rings (see
+ *     events.h), such as the one mdriver -E writes.
+ *
+ * Prints each thread's operations, oldest first, one to a line: the
+ * operation's number in its thread, what it was, the size asked for
+ * (or freed), the heap offset of the block, how many free blocks the
+ * search looked at, and what else it did. With -s, prints only a
+ * summary of each ring; with -n <n>, only its last n operations.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "events.h"
+
+static char *ops[] = {"?", "malloc", "free", "realloc", "memalign", "hint"};
+#define NUM_OPS ((int)(sizeof(ops) / sizeof(ops[0])))
+
+static void print_event(mm_event_t *e);
+static void print_summary(mm_events_ring_t *r, mm_event_t *ev);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    mm_events_hdr_t hdr;
+    mm_events_ring_t r;
+    mm_event_t *ev;
+    FILE *fp;
+    unsigned int i, n;
+    long last = -1;
+    int c, summary = 0;
+
+    while ((c = getopt(argc, argv, "hn:s")) != EOF) {
+	switch (c) {
+	case 'n': /* Print only the last n operations of each ring */
+	    if ((last = atol(optarg)) < 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 's': /* Print only a summary of each ring */
+	    summary = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	usage();
+	exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "r")) == NULL) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != MM_EVENTS_MAGIC) {
+	fprintf(stderr, "mmevents: %s is not an event dump\n", argv[optind]);
+	exit(1);
+    }
+
+    for (n = 0; n < hdr.rings; n++) {
+	if (fread(&r, sizeof(r), 1, fp) != 1 ||
+	    (ev = malloc((r.count ? r.count : 1) * sizeof(mm_event_t))) == NULL ||
+	    fread(ev, sizeof(mm_event_t), r.count, fp) != r.count) {
+	    fprintf(stderr, "mmevents: %s is truncated\n", argv[optind]);
+	    exit(1);
+	}
+
+	printf("Thread %u: %u of %llu operations\n", r.thread, r.count, r.total);
+	if (summary)
+	    print_summary(&r, ev);
+	else {
+	    printf("%10s %-9s%10s%10s%8s  %s\n",
+		   "seq", "op", "size", "block", "visited", "flags");
+	    i = (last >= 0 && last < r.count) ? r.count - last : 0;
+	    for (; i < r.count; i++)
+		print_event(&ev[i]);
+	}
+	printf("\n");
+	free(ev);
+    }
+    fclose(fp);
+    exit(0);
+}
+
+/*
+ * print_event - Print one operation
+ */
+static void print_event(mm_event_t *e)
+{
+    printf("%10u %-9s%10u%10u%8u  %s%s%s%s%s%s\n", e->seq,
+	   e->op < NUM_OPS ? ops[e->op] : "?", e->size, e->block, e->visited,
+	   e->flags & MM_EVF_SPLIT ? "split " : "",
+	   e->flags & MM_EVF_COALESCE1 ? "coalesce-next " : "",
+	   e->flags & MM_EVF_COALESCE2 ? "coalesce-prev " : "",
+	   e->flags & MM_EVF_COALESCE3 ? "coalesce-both " : "",
+	   e->flags & MM_EVF_GREW ? "grew " : "",
+	   e->flags & MM_EVF_FAILED ? "FAILED" : "");
+}
+
+/*
+ * print_summary - Print how many of a ring's operations were of each
+ *     kind, how far their searches went, and what else they did
+ */
+static void print_summary(mm_events_ring_t *r, mm_event_t *ev)
+{
+    unsigned long count[NUM_OPS], visited[NUM_OPS], most[NUM_OPS];
+    unsigned long split = 0, coalesced = 0, grew = 0, failed = 0;
+    unsigned int i;
+    int op;
+
+    memset(count, 0, sizeof(count));
+    memset(visited, 0, sizeof(visited));
+    memset(most, 0, sizeof(most));
+    for (i = 0; i < r->count; i++) {
+	op = ev[i].op < NUM_OPS ? ev[i].op : 0;
+	count[op]++;
+	visited[op] += ev[i].visited;
+	if (ev[i].visited > most[op])
+	    most[op] = ev[i].visited;
+	split += (ev[i].flags & MM_EVF_SPLIT) != 0;
+	coalesced += (ev[i].flags & (MM_EVF_COALESCE1 | MM_EVF_COALESCE2 |
+				     MM_EVF_COALESCE3)) != 0;
+	grew += (ev[i].flags & MM_EVF_GREW) != 0;
+	failed += (ev[i].flags & MM_EVF_FAILED) != 0;
+    }
+
+    printf("%-9s%10s%14s%12s\n", "op", "count", "avg visited", "max visited");
+    for (op = 0; op < NUM_OPS; op++)
+	if (count[op])
+	    printf("%-9s%10lu%14.1f%12lu\n", ops[op], count[op],
+		   (double)visited[op] / count[op], most[op]);
+    printf("split %lu, coalesced %lu, grew the heap %lu, failed %lu\n",
+	   split, coalesced, grew, failed);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmevents [-hs] [-n <n>] <dump>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Print only the last <n> operations of each thread.\n");
+    fprintf(stderr, "\t-s         Print only a summary of each thread's operations.\n");
+}
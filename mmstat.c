@@ -0,0 +1,191 @@
+/*
+ * mmstat.c - Samples the live statistics a process running mm.c with
+ *     mm_config "stats=<name>" keeps in shared memory (see statpage.h),
+ *     in the manner of vmstat.
+ *
+ * Every interval, prints the live and heap bytes, how much of the heap
+ * is not live, and the rates of mallocs, frees, reallocs and waits for
+ * the shared heap lock over the interval. With -c, also prints the
+ * interval's mallocs by request size class. The reader only maps the
+ * page read-only, so it can neither block nor disturb the allocator.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "statpage.h"
+
+#define HEADER_EVERY 20  /* samples between repeated column headers */
+
+static void print_header(void);
+static void print_sample(mm_statpage_t *s, mm_statpage_t *last, double secs);
+static void print_classes(mm_statpage_t *s, mm_statpage_t *last, double secs);
+static double now(void);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    const mm_statpage_t *page;
+    mm_statpage_t s, last;
+    struct timespec ts;
+    char name[256];
+    double interval = 1.0, t, tlast;
+    long count = 0, n;
+    int c, classes = 0;
+
+    while ((c = getopt(argc, argv, "chi:n:")) != EOF) {
+	switch (c) {
+	case 'c': /* Print mallocs by size class too */
+	    classes = 1;
+	    break;
+	case 'i': /* Seconds between samples */
+	    if ((interval = atof(optarg)) <= 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'n': /* Stop after this many samples */
+	    if ((count = atol(optarg)) < 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	usage();
+	exit(1);
+    }
+
+    snprintf(name, sizeof(name), "%s%s",
+	     argv[optind][0] == '/' ? "" : "/", argv[optind]);
+    if ((page = mm_statpage_attach(name)) == NULL) {
+	fprintf(stderr, "mmstat: no statistics page %s: %s\n",
+		name, strerror(errno));
+	exit(1);
+    }
+    if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != MM_STATPAGE_MAGIC ||
+	page->classes != MM_STAT_CLASSES) {
+	fprintf(stderr, "mmstat: %s is not a statistics page of this build\n",
+		name);
+	exit(1);
+    }
+
+    if (mm_statpage_read(page, &last) < 0) {
+	fprintf(stderr, "mmstat: %s never settles\n", name);
+	exit(1);
+    }
+    tlast = now();
+    ts.tv_sec = (time_t)interval;
+    ts.tv_nsec = (long)((interval - ts.tv_sec) * 1e9);
+
+    for (n = 0; count == 0 || n < count; n++) {
+	nanosleep(&ts, NULL);
+	if (mm_statpage_read(page, &s) < 0) {
+	    fprintf(stderr, "mmstat: %s never settles\n", name);
+	    exit(1);
+	}
+	t = now();
+
+	if (s.pid != last.pid) {  /* another process took the page over */
+	    printf("process %d took over %s\n", s.pid, name);
+	    last = s;
+	    tlast = t;
+	    n--;
+	    continue;
+	}
+	if (n % HEADER_EVERY == 0 || classes)
+	    print_header();
+	print_sample(&s, &last, t - tlast);
+	if (classes)
+	    print_classes(&s, &last, t - tlast);
+	fflush(stdout);
+
+	if (kill(s.pid, 0) < 0 && errno == ESRCH) {
+	    printf("process %d has exited\n", s.pid);
+	    break;
+	}
+	last = s;
+	tlast = t;
+    }
+    exit(0);
+}
+
+/*
+ * print_header - Print the column headers
+ */
+static void print_header(void)
+{
+    printf("%12s %12s %6s %11s %11s %11s %9s\n", "live", "heap", "free%",
+	   "mallocs/s", "frees/s", "reallocs/s", "waits/s");
+}
+
+/*
+ * print_sample - Print one interval's line: the sizes now, and the
+ *     rates since the last sample
+ */
+static void print_sample(mm_statpage_t *s, mm_statpage_t *last, double secs)
+{
+    double frag = s->heap_bytes ?
+	100.0 * (s->heap_bytes - s->live_bytes) / s->heap_bytes : 0.0;
+
+    printf("%12llu %12llu %6.1f %11.0f %11.0f %11.0f %9.0f\n",
+	   s->live_bytes, s->heap_bytes, frag,
+	   (s->mallocs - last->mallocs) / secs,
+	   (s->frees - last->frees) / secs,
+	   (s->reallocs - last->reallocs) / secs,
+	   (s->lock_waits - last->lock_waits) / secs);
+}
+
+/*
+ * print_classes - Print the classes that had mallocs in the interval,
+ *     by the largest request of each
+ */
+static void print_classes(mm_statpage_t *s, mm_statpage_t *last, double secs)
+{
+    unsigned long long d;
+    unsigned int c;
+
+    for (c = 0; c < MM_STAT_CLASSES; c++) {
+	if ((d = s->class_mallocs[c] - last->class_mallocs[c]) == 0)
+	    continue;
+	if (s->class_size[c])
+	    printf("    <= %-8u %11.0f/s\n", s->class_size[c], d / secs);
+	else
+	    printf("    larger   %11.0f/s\n", d / secs);
+    }
+}
+
+/*
+ * now - The time in seconds on a clock that only goes forward
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmstat [-ch] [-i <secs>] [-n <count>] <name>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c         Print each sample's mallocs by size class too.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-i <secs>  Sample every <secs> seconds (default 1).\n");
+    fprintf(stderr, "\t-n <count> Stop after <count> samples (default: until the process exits).\n");
+}
@@ -0,0 +1,204 @@
+/*
+ * mmtrace.c - The built-in consumer of the tracepoints in mm.c (see
+ *     mmtrace.h). It counts the hits of each enabled tracepoint, sums
+ *     their arguments, and times every find_fit from its entry to its
+ *     exit into a power-of-two histogram.
+ *
+ * Counts are added atomically so that threads sharing a heap may all
+ * be traced; the entry time of a search is kept per thread.
+ *
+ * Where MM_TRACE is a patched nop, the linker gathers the sites into
+ * the mm_trace_sites section, and enabling a tracepoint writes a jump
+ * over each of its nops, making the text writable for the moment.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mmtrace.h"
+
+#define LAT_BUCKETS 32  /* latency histogram buckets: [2^i, 2^(i+1)) ns */
+
+/* The name of each tracepoint, and what its argument is */
+static struct {
+    char *name;
+    char *arg;
+} points[MM_TP_COUNT] = {
+    {"find_fit_enter", "request"},
+    {"find_fit_exit", "found"},
+    {"split", "remainder"},
+    {"coalesce1", "merged"},
+    {"coalesce2", "merged"},
+    {"coalesce3", "merged"},
+    {"extend_heap", "bytes"},
+};
+
+/* The names mm_trace_enable takes, and the tracepoints they stand for */
+static struct {
+    char *name;
+    unsigned int mask;
+} groups[] = {
+    {"find_fit", (1u << MM_TP_FIND_FIT_ENTER) | (1u << MM_TP_FIND_FIT_EXIT)},
+    {"split", 1u << MM_TP_SPLIT},
+    {"coalesce", (1u << MM_TP_COALESCE1) | (1u << MM_TP_COALESCE2) |
+     (1u << MM_TP_COALESCE3)},
+    {"extend_heap", 1u << MM_TP_EXTEND_HEAP},
+    {"all", (1u << MM_TP_COUNT) - 1},
+    {NULL, 0}
+};
+
+unsigned int mm_trace_mask = 0;
+
+static unsigned long long hits[MM_TP_COUNT];    /* hits of each tracepoint */
+static unsigned long long args[MM_TP_COUNT];    /* sum of their arguments */
+static unsigned long long lat_ns;               /* time spent in find_fit */
+static unsigned long long lat_max;              /* longest find_fit */
+static unsigned long long lat_hist[LAT_BUCKETS];
+static __thread unsigned long long enter_ns;    /* when this thread's search started */
+
+#ifdef MM_TRACE_PATCHED
+/* The sites, between the symbols the linker defines for the section */
+extern mm_trace_site_t __start_mm_trace_sites[] __attribute__((weak));
+extern mm_trace_site_t __stop_mm_trace_sites[] __attribute__((weak));
+
+static const unsigned char nop5[5] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+
+/*
+ * patch_sites - Turn the nop of each site whose tracepoint is in mask
+ *     into a jump to its call of mm_trace_hit, and the rest back into
+ *     nops. Returns -1 if the text cannot be made writable.
+ */
+static int patch_sites(unsigned int mask)
+{
+    mm_trace_site_t *s;
+    unsigned char insn[5];
+    uintptr_t page, pagesize = sysconf(_SC_PAGESIZE);
+    int32_t rel;
+
+    for (s = __start_mm_trace_sites; s < __stop_mm_trace_sites; s++) {
+	if (mask & (1u << s->tp)) {
+	    rel = (int32_t)(s->target - (s->addr + sizeof(insn)));
+	    insn[0] = 0xe9;  /* jmp rel32 */
+	    memcpy(insn + 1, &rel, sizeof(rel));
+	}
+	else
+	    memcpy(insn, nop5, sizeof(insn));
+	if (!memcmp((void *)s->addr, insn, sizeof(insn)))
+	    continue;
+
+	page = s->addr & ~(pagesize - 1);
+	if (mprotect((void *)page, s->addr + sizeof(insn) - page,
+		     PROT_READ | PROT_WRITE | PROT_EXEC) < 0)
+	    return -1;
+	memcpy((void *)s->addr, insn, sizeof(insn));
+	mprotect((void *)page, s->addr + sizeof(insn) - page,
+		 PROT_READ | PROT_EXEC);
+    }
+    return 0;
+}
+#endif
+
+/* Return the monotonic clock in ns */
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int mm_trace_enable(const char *names)
+{
+    unsigned int mask = 0;
+    size_t len;
+    int i;
+
+    while (*names) {
+	len = strcspn(names, ",");
+	for (i = 0; groups[i].name; i++)
+	    if (strlen(groups[i].name) == len &&
+		!strncmp(groups[i].name, names, len))
+		break;
+	if (!groups[i].name)
+	    return -1;
+	mask |= groups[i].mask;
+	names += len;
+	if (*names == ',')
+	    names++;
+    }
+#ifdef MM_TRACE_PATCHED
+    if (patch_sites(mask) < 0) {
+	patch_sites(mm_trace_mask);
+	return -1;
+    }
+#endif
+    mm_trace_mask = mask;
+    return 0;
+}
+
+void mm_trace_hit(int tp, size_t arg)
+{
+    unsigned long long ns, max;
+    int b;
+
+    __atomic_fetch_add(&hits[tp], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&args[tp], arg, __ATOMIC_RELAXED);
+
+    if (tp == MM_TP_FIND_FIT_ENTER)
+	enter_ns = now_ns();
+    else if (tp == MM_TP_FIND_FIT_EXIT && enter_ns) {
+	ns = now_ns() - enter_ns;
+	enter_ns = 0;
+	__atomic_fetch_add(&lat_ns, ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&lat_max, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&lat_max, &max, ns, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    ;
+	b = ns ? 63 - __builtin_clzll(ns) : 0;
+	__atomic_fetch_add(&lat_hist[b < LAT_BUCKETS ? b : LAT_BUCKETS - 1],
+			   1, __ATOMIC_RELAXED);
+    }
+}
+
+void mm_trace_reset(void)
+{
+    memset(hits, 0, sizeof(hits));
+    memset(args, 0, sizeof(args));
+    memset(lat_hist, 0, sizeof(lat_hist));
+    lat_ns = lat_max = 0;
+    enter_ns = 0;
+}
+
+void mm_trace_print(FILE *fp)
+{
+    unsigned long long timed = 0, seen = 0;
+    int tp, b, p50 = -1, p99 = -1;
+
+    fprintf(fp, "%-16s%12s%12s%10s\n", "tracepoint", "hits", "avg arg", "arg");
+    for (tp = 0; tp < MM_TP_COUNT; tp++) {
+	if (!(mm_trace_mask & (1u << tp)))
+	    continue;
+	fprintf(fp, "%-16s%12llu%12.1f%10s\n", points[tp].name, hits[tp],
+		hits[tp] ? (double)args[tp] / hits[tp] : 0.0, points[tp].arg);
+    }
+
+    for (b = 0; b < LAT_BUCKETS; b++)
+	timed += lat_hist[b];
+    if (timed == 0)
+	return;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+	seen += lat_hist[b];
+	if (p50 < 0 && seen * 2 >= timed)
+	    p50 = b;
+	if (p99 < 0 && seen * 100 >= timed * 99)
+	    p99 = b;
+    }
+    fprintf(fp, "find_fit latency: avg %.0f ns, p50 < %llu ns, "
+	    "p99 < %llu ns, max %llu ns\n", (double)lat_ns / timed,
+	    2ULL << p50, 2ULL << p99, lat_max);
+}
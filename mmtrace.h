@@ -0,0 +1,98 @@
+/*
+ * mmtrace.h - Static tracepoints in the allocator's hot paths, and the
+ *     small consumer in mmtrace.c that counts them and times find_fit
+ *
+ * mm.c marks its tracepoints with MM_TRACE(tp, name, arg). What that
+ * compiles to depends on the build (see the Makefile):
+ *
+ *     default        nothing at all
+ *     make TRACE=1   on x86-64, a 5-byte nop that mm_trace_enable
+ *                    patches into a jump to a call of mm_trace_hit, and
+ *                    back; elsewhere, a test of one bit of mm_trace_mask,
+ *                    predicted not taken
+ *     make SDT=1     a systemtap/USDT probe "mm:<name>" from sys/sdt.h:
+ *                    a single nop plus an ELF note, for perf, bpftrace
+ *                    or stap to attach to; the consumer here is unused
+ *
+ * The default build compiles them away, so they can stay in release
+ * code. A disabled TRACE=1 point costs one nop on x86-64. Enabling
+ * rewrites mm.c's code, so it must not race with other threads in mm.c.
+ *
+ * Only find_fit has an entry and an exit, so it is the only point that
+ * is timed. split, coalesce and extend_heap are single points inside
+ * their functions, so they are counted along with their arguments.
+ */
+#ifndef MMTRACE_H
+#define MMTRACE_H
+
+#include <stdio.h>
+
+/* The tracepoints. The argument each passes is in mmtrace.c. */
+enum {
+    MM_TP_FIND_FIT_ENTER,  /* find_fit starts a search */
+    MM_TP_FIND_FIT_EXIT,   /* ... and returns, timed from the entry */
+    MM_TP_SPLIT,           /* place splits a free block */
+    MM_TP_COALESCE1,       /* coalesce merges with the next block */
+    MM_TP_COALESCE2,       /* ... with the previous block */
+    MM_TP_COALESCE3,       /* ... with both */
+    MM_TP_EXTEND_HEAP,     /* extend_heap grows the heap */
+    MM_TP_COUNT
+};
+
+#if defined(MM_TRACEPOINTS_SDT)
+#include <sys/sdt.h>
+#define MM_TRACE(tp, name, arg) DTRACE_PROBE1(mm, name, arg)
+#elif defined(MM_TRACEPOINTS) && defined(__x86_64__) && defined(__GNUC__)
+#define MM_TRACE_PATCHED 1
+
+/* Where each tracepoint's nop is, and where its jump goes when enabled */
+typedef struct {
+    unsigned long addr;
+    unsigned long target;
+    unsigned long tp;
+} mm_trace_site_t;
+
+#define MM_TRACE(tp, name, arg) \
+    do { \
+	__label__ mm_trace_on; \
+	asm goto ("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t" \
+		  ".pushsection mm_trace_sites, \"aw\"\n\t" \
+		  ".balign 8\n\t" \
+		  ".quad 1b, %l[mm_trace_on], %c0\n\t" \
+		  ".popsection" \
+		  : : "i" (tp) : : mm_trace_on); \
+	break; \
+    mm_trace_on: \
+	mm_trace_hit(tp, (size_t)(arg)); \
+    } while (0)
+#elif defined(MM_TRACEPOINTS)
+#define MM_TRACE(tp, name, arg) \
+    do { \
+	if (__builtin_expect(mm_trace_mask & (1u << (tp)), 0)) \
+	    mm_trace_hit(tp, (size_t)(arg)); \
+    } while (0)
+#else
+#define MM_TRACE(tp, name, arg) ((void)0)
+#endif
+
+/* Bit tp is set if tracepoint tp is enabled */
+extern unsigned int mm_trace_mask;
+
+/*
+ * mm_trace_enable - Enable the tracepoints named in a comma-separated
+ *     list and disable the rest: find_fit, split, coalesce, extend_heap,
+ *     or all. An empty list disables them all. Returns -1 on an unknown
+ *     name, leaving the mask as it was, or if the code cannot be patched.
+ */
+int mm_trace_enable(const char *names);
+
+/* mm_trace_hit - Count a hit of tracepoint tp; called by MM_TRACE */
+void mm_trace_hit(int tp, size_t arg);
+
+/* mm_trace_reset - Zero the counts and times */
+void mm_trace_reset(void);
+
+/* mm_trace_print - Print the counts and times since the last reset */
+void mm_trace_print(FILE *fp);
+
+#endif /* MMTRACE_H */
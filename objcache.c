@@ -0,0 +1,191 @@
+/*
+ * objcache.c - Object caches with constructed-state preservation, after
+ *     Bonwick's slab allocator, on top of the mm malloc package.
+ *
+ * Slabs are power-of-two sized and aligned, obtained with mm_memalign
+ * like those of pool.c (see slab.h), so an object's slab is found by
+ * masking its address. Because a free object must keep its constructed state, the
+ * free list link is not stored in the object but in a word right after
+ * it; an object and its link make up one buffer. Buffers are carved
+ * (and constructed) lazily by bumping a pointer through the slab.
+ *
+ * The space a slab has left over after its buffers is used for
+ * coloring: successive slabs start their buffers CACHE_LINE bytes
+ * further in, wrapping around when the left-over space is used up.
+ *
+ * Slabs live on three lists: partial (some buffers free), full and
+ * empty. Empty slabs keep their constructed objects until reaped.
+ */
+#include <stdlib.h>
+
+#include "objcache.h"
+#include "mm.h"
+#include "slab.h"
+
+#define CACHE_SLABSIZE 4096   /* smallest slab size in bytes */
+#define CACHE_MINOBJS  8      /* fewest objects a slab may hold */
+#define CACHE_ALIGN    8      /* default object alignment */
+#define CACHE_LINE     64     /* color step, the size of a cache line */
+
+struct mm_cache {
+    size_t linkoff;       /* offset of the free list link in a buffer */
+    size_t bufsize;       /* object plus link, rounded to the alignment */
+    size_t slabsize;      /* slab size (and alignment) */
+    size_t first;         /* offset of the first buffer before coloring */
+    size_t perslab;       /* objects per slab */
+    size_t colorstep;     /* distance between colors */
+    size_t maxcolor;      /* largest color that still fits */
+    size_t color;         /* color of the next new slab */
+    mm_cache_fn ctor;
+    mm_cache_fn dtor;
+    void *arg;
+    slab_t *partial;
+    slab_t *full;
+    slab_t *empty;
+};
+
+/* The free list link of buffer p */
+#define LINK(c, p) (*(void **)((char *)(p) + (c)->linkoff))
+
+/* new_slab - Put a fresh slab with the next color on the partial list */
+static slab_t *new_slab(mm_cache_t *cache)
+{
+    slab_t *s;
+
+    if ((s = (slab_t *)mm_memalign(cache->slabsize, SLAB_PAYLOAD(cache))) == NULL)
+	return NULL;
+    s->free = NULL;
+    s->start = s->bump = (char *)s + cache->first + cache->color;
+    s->inuse = 0;
+    push_slab(&cache->partial, s);
+
+    cache->color += cache->colorstep;
+    if (cache->color > cache->maxcolor)
+	cache->color = 0;
+    return s;
+}
+
+/* reclaim - Destruct every object ever constructed in slab s and free it */
+static void reclaim(mm_cache_t *cache, slab_t *s)
+{
+    char *p;
+
+    if (cache->dtor)
+	for (p = s->start; p < s->bump; p += cache->bufsize)
+	    cache->dtor(p, cache->arg);
+    mm_free(s);
+}
+
+mm_cache_t *mm_cache_create(size_t objsize, size_t align, 
+			    mm_cache_fn ctor, mm_cache_fn dtor, void *arg)
+{
+    mm_cache_t *cache;
+    size_t leftover;
+
+    if (align == 0)
+	align = CACHE_ALIGN;
+    if (align & (align - 1))
+	return NULL;
+    if ((cache = (mm_cache_t *)mm_malloc(sizeof(mm_cache_t))) == NULL)
+	return NULL;
+
+    cache->linkoff = ROUNDUP(objsize, sizeof(void *));
+    cache->bufsize = ROUNDUP(cache->linkoff + sizeof(void *), align);
+    cache->first = ROUNDUP(sizeof(slab_t), align);
+    cache->slabsize = CACHE_SLABSIZE;
+    while (SLAB_PAYLOAD(cache) < cache->first + CACHE_MINOBJS * cache->bufsize)
+	cache->slabsize *= 2;
+    cache->perslab = (SLAB_PAYLOAD(cache) - cache->first) / cache->bufsize;
+
+    /* Colors must keep the alignment and fit in the left-over space */
+    leftover = SLAB_PAYLOAD(cache) - cache->first - 
+	cache->perslab * cache->bufsize;
+    cache->colorstep = ROUNDUP(CACHE_LINE, align);
+    cache->maxcolor = leftover - leftover % cache->colorstep;
+    cache->color = 0;
+
+    cache->ctor = ctor;
+    cache->dtor = dtor;
+    cache->arg = arg;
+    cache->partial = cache->full = cache->empty = NULL;
+    return cache;
+}
+
+void *mm_cache_alloc(mm_cache_t *cache)
+{
+    slab_t *s;
+    void *p;
+
+    /* Prefer partial slabs, then empty ones, then a new slab */
+    if ((s = cache->partial) == NULL) {
+	if ((s = cache->empty) != NULL) {
+	    unlink_slab(&cache->empty, s);
+	    push_slab(&cache->partial, s);
+	}
+	else if ((s = new_slab(cache)) == NULL)
+	    return NULL;
+    }
+
+    /* A freed object is still constructed; a fresh one is not yet */
+    if ((p = s->free) != NULL)
+	s->free = LINK(cache, p);
+    else {
+	p = s->bump;
+	s->bump += cache->bufsize;
+	if (cache->ctor)
+	    cache->ctor(p, cache->arg);
+    }
+
+    if (++s->inuse == cache->perslab) {
+	unlink_slab(&cache->partial, s);
+	push_slab(&cache->full, s);
+    }
+    return p;
+}
+
+void mm_cache_free(mm_cache_t *cache, void *obj)
+{
+    slab_t *s = SLAB_OF(cache, obj);
+
+    if (s->inuse == cache->perslab) {
+	unlink_slab(&cache->full, s);
+	push_slab(&cache->partial, s);
+    }
+    LINK(cache, obj) = s->free;
+    s->free = obj;
+
+    if (--s->inuse == 0) {
+	unlink_slab(&cache->partial, s);
+	push_slab(&cache->empty, s);
+    }
+}
+
+int mm_cache_reap(mm_cache_t *cache)
+{
+    slab_t *s, *next;
+    int n = 0;
+
+    for (s = cache->empty; s != NULL; s = next) {
+	next = s->next;
+	reclaim(cache, s);
+	n++;
+    }
+    cache->empty = NULL;
+    return n;
+}
+
+void mm_cache_destroy(mm_cache_t *cache)
+{
+    slab_t *s, *next;
+
+    mm_cache_reap(cache);
+    for (s = cache->partial; s != NULL; s = next) {
+	next = s->next;
+	reclaim(cache, s);
+    }
+    for (s = cache->full; s != NULL; s = next) {
+	next = s->next;
+	reclaim(cache, s);
+    }
+    mm_free(cache);
+}
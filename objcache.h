@@ -0,0 +1,46 @@
+/*
+ * objcache.h - Object caches with constructed-state preservation, after
+ *     Bonwick's slab allocator, on top of the mm malloc package.
+ *
+ * A cache hands out objects of one type. The constructor runs when an
+ * object is first carved from a slab, not on every allocation: a freed
+ * object goes back on its slab still constructed, so the next
+ * mm_cache_alloc returns it ready to use. The destructor only runs when
+ * an empty slab is reclaimed by mm_cache_reap or mm_cache_destroy. Each
+ * new slab starts its objects at a different cache-line offset (its
+ * color), so that the hot first lines of objects in different slabs
+ * spread over the cache sets instead of competing for the same ones.
+ */
+#include <stddef.h>
+
+typedef struct mm_cache mm_cache_t;
+
+/* Constructors and destructors get the object and the cache's arg */
+typedef void (*mm_cache_fn)(void *obj, void *arg);
+
+/* 
+ * mm_cache_create - Create a cache of objects of objsize bytes, aligned
+ *     to align bytes (a power of two, 0 for the default of 8). ctor and
+ *     dtor may be NULL. Returns NULL on a bad alignment or if the mm
+ *     heap is out of memory.
+ */
+mm_cache_t *mm_cache_create(size_t objsize, size_t align, 
+			    mm_cache_fn ctor, mm_cache_fn dtor, void *arg);
+
+/* mm_cache_alloc - Return a constructed object, or NULL if out of memory */
+void *mm_cache_alloc(mm_cache_t *cache);
+
+/* mm_cache_free - Return an object, which must be in its constructed state */
+void mm_cache_free(mm_cache_t *cache, void *obj);
+
+/* 
+ * mm_cache_reap - Destruct the objects of every empty slab and give the
+ *     slabs back to the mm heap. Returns the number of slabs reclaimed.
+ */
+int mm_cache_reap(mm_cache_t *cache);
+
+/* 
+ * mm_cache_destroy - Reclaim every slab and the cache itself. All
+ *     objects must have been freed.
+ */
+void mm_cache_destroy(mm_cache_t *cache);
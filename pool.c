@@ -0,0 +1,131 @@
+/*
+ * pool.c - Fixed-size object pools on top of the mm malloc package.
+ *
+ * Slabs are power-of-two sized and aligned, obtained with mm_memalign,
+ * so the slab header of any object is at its address rounded down to
+ * the slab size (see slab.h). Objects are carved lazily by bumping a
+ * pointer through the slab; freed objects go on the slab's embedded
+ * free list. Slabs with free objects sit on the pool's partial list,
+ * full slabs on its full list. When a slab empties it is kept as the
+ * pool's spare if there is none yet, and otherwise freed back to the
+ * mm heap.
+ */
+#include <stdlib.h>
+
+#include "pool.h"
+#include "mm.h"
+#include "slab.h"
+
+#define POOL_SLABSIZE 4096   /* smallest slab size in bytes */
+#define POOL_MINOBJS  8      /* fewest objects a slab may hold */
+#define POOL_ALIGN    8      /* default object alignment */
+
+struct mm_pool {
+    size_t objsize;       /* object size, rounded up to the alignment */
+    size_t slabsize;      /* slab size (and alignment) */
+    size_t first;         /* offset of the first object in a slab */
+    size_t perslab;       /* objects per slab */
+    slab_t *partial;      /* slabs with free objects */
+    slab_t *full;         /* slabs without */
+    slab_t *spare;        /* one empty slab kept for reuse */
+};
+
+/* new_slab - Put a fresh (or the spare) slab on the partial list */
+static slab_t *new_slab(mm_pool_t *pool)
+{
+    slab_t *s;
+
+    if ((s = pool->spare) != NULL)
+	pool->spare = NULL;
+    else if ((s = (slab_t *)mm_memalign(pool->slabsize, SLAB_PAYLOAD(pool))) == NULL)
+	return NULL;
+    s->free = NULL;
+    s->start = s->bump = (char *)s + pool->first;
+    s->inuse = 0;
+    push_slab(&pool->partial, s);
+    return s;
+}
+
+mm_pool_t *mm_pool_create(size_t objsize, size_t align)
+{
+    mm_pool_t *pool;
+
+    if (align == 0)
+	align = POOL_ALIGN;
+    if (align & (align - 1))
+	return NULL;
+    if ((pool = (mm_pool_t *)mm_malloc(sizeof(mm_pool_t))) == NULL)
+	return NULL;
+
+    /* Every object must be able to hold the free list link */
+    if (objsize < sizeof(void *))
+	objsize = sizeof(void *);
+    pool->objsize = ROUNDUP(objsize, align);
+    pool->first = ROUNDUP(sizeof(slab_t), align);
+    pool->slabsize = POOL_SLABSIZE;
+    while (SLAB_PAYLOAD(pool) < pool->first + POOL_MINOBJS * pool->objsize)
+	pool->slabsize *= 2;
+    pool->perslab = (SLAB_PAYLOAD(pool) - pool->first) / pool->objsize;
+    pool->partial = pool->full = pool->spare = NULL;
+    return pool;
+}
+
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    slab_t *s;
+    void *p;
+
+    if ((s = pool->partial) == NULL && (s = new_slab(pool)) == NULL)
+	return NULL;
+
+    if ((p = s->free) != NULL)
+	s->free = *(void **)p;
+    else {
+	p = s->bump;
+	s->bump += pool->objsize;
+    }
+
+    if (++s->inuse == pool->perslab) {
+	unlink_slab(&pool->partial, s);
+	push_slab(&pool->full, s);
+    }
+    return p;
+}
+
+void mm_pool_free(mm_pool_t *pool, void *p)
+{
+    slab_t *s = SLAB_OF(pool, p);
+
+    if (s->inuse == pool->perslab) {
+	unlink_slab(&pool->full, s);
+	push_slab(&pool->partial, s);
+    }
+    *(void **)p = s->free;
+    s->free = p;
+
+    /* Keep one empty slab around, give any others back to the heap */
+    if (--s->inuse == 0) {
+	unlink_slab(&pool->partial, s);
+	if (pool->spare == NULL)
+	    pool->spare = s;
+	else
+	    mm_free(s);
+    }
+}
+
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    slab_t *s, *next;
+
+    for (s = pool->partial; s != NULL; s = next) {
+	next = s->next;
+	mm_free(s);
+    }
+    for (s = pool->full; s != NULL; s = next) {
+	next = s->next;
+	mm_free(s);
+    }
+    if (pool->spare)
+	mm_free(pool->spare);
+    mm_free(pool);
+}
@@ -0,0 +1,28 @@
+/*
+ * pool.h - Fixed-size object pools on top of the mm malloc package.
+ *
+ * A pool hands out objects of one size from slabs it carves from the mm
+ * heap. Objects carry no header: the slab an object belongs to is found
+ * by masking its address, and free objects are chained through their
+ * first word. Allocation and free are O(1), and a slab that becomes
+ * empty is returned to the mm heap.
+ */
+#include <stddef.h>
+
+typedef struct mm_pool mm_pool_t;
+
+/* 
+ * mm_pool_create - Create a pool of objects of objsize bytes, aligned
+ *     to align bytes (a power of two, 0 for the default of 8). Returns
+ *     NULL on a bad alignment or if the mm heap is out of memory.
+ */
+mm_pool_t *mm_pool_create(size_t objsize, size_t align);
+
+/* mm_pool_alloc - Allocate one object, or return NULL if out of memory */
+void *mm_pool_alloc(mm_pool_t *pool);
+
+/* mm_pool_free - Return an object obtained from mm_pool_alloc */
+void mm_pool_free(mm_pool_t *pool, void *p);
+
+/* mm_pool_destroy - Return every slab and the pool itself to the mm heap */
+void mm_pool_destroy(mm_pool_t *pool);
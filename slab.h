@@ -0,0 +1,57 @@
+/*
+ * slab.h - The slab lists that pool.c and objcache.c share. Internal
+ *     to the two, not part of either's interface.
+ *
+ * Slabs are power-of-two sized and aligned, obtained with mm_memalign,
+ * so the slab header of any object is at its address rounded down to
+ * the slab size. A slab's payload stops MM_BLOCK_OVERHEAD bytes short
+ * of the slab size, so that consecutive slabs pack without gaps. The
+ * macros take the pool or cache, which both keep the slab size in a
+ * slabsize field. Include mm.h first.
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/* rounds size up to a multiple of the power of two a */
+#define ROUNDUP(size, a) (((size) + ((a)-1)) & ~(size_t)((a)-1))
+
+/* Usable bytes of a slab */
+#define SLAB_PAYLOAD(c) ((c)->slabsize - MM_BLOCK_OVERHEAD)
+
+/* Return the slab holding object p */
+#define SLAB_OF(c, p) ((slab_t *)((size_t)(p) & ~((c)->slabsize - 1)))
+
+/* The header at the start of each slab */
+typedef struct slab {
+    struct slab *next;    /* neighbors on the list the slab is on */
+    struct slab *prev;
+    void *free;           /* list of freed objects */
+    char *start;          /* first object, after the header and any color */
+    char *bump;           /* first object never handed out */
+    size_t inuse;         /* number of allocated objects */
+} slab_t;
+
+/* unlink_slab - Take slab s off the list it is on */
+static inline void unlink_slab(slab_t **list, slab_t *s)
+{
+    if (s->prev)
+	s->prev->next = s->next;
+    else
+	*list = s->next;
+    if (s->next)
+	s->next->prev = s->prev;
+}
+
+/* push_slab - Put slab s at the front of a list */
+static inline void push_slab(slab_t **list, slab_t *s)
+{
+    s->prev = NULL;
+    s->next = *list;
+    if (*list)
+	(*list)->prev = s;
+    *list = s;
+}
+
+#endif /* SLAB_H */
@@ -0,0 +1,77 @@
+/*
+ * statpage.c - Setting up, attaching to and reading the shared page of
+ *     allocator statistics (see statpage.h)
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "statpage.h"
+
+#define READ_TRIES 1000000  /* updates a reader waits out before giving up */
+
+mm_statpage_t *mm_statpage_open(const char *name)
+{
+    mm_statpage_t *page;
+    int fd, c;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0644)) < 0)
+	return NULL;
+    if (ftruncate(fd, sizeof(mm_statpage_t)) < 0) {
+	close(fd);
+	return NULL;
+    }
+    page = mmap(NULL, sizeof(mm_statpage_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED)
+	return NULL;
+
+    /* A page left behind by a process that died is started over */
+    page->magic = 0;
+    memset((char *)page + sizeof(page->magic), 0,
+	   sizeof(mm_statpage_t) - sizeof(page->magic));
+    page->classes = MM_STAT_CLASSES;
+    page->pid = getpid();
+    for (c = 0; c < MM_NUM_CLASSES; c++)
+	page->class_size[c] = mm_class_size[c];
+    __atomic_store_n(&page->magic, MM_STATPAGE_MAGIC, __ATOMIC_RELEASE);
+    return page;
+}
+
+void mm_statpage_close(mm_statpage_t *page, const char *name)
+{
+    munmap(page, sizeof(mm_statpage_t));
+    shm_unlink(name);
+}
+
+const mm_statpage_t *mm_statpage_attach(const char *name)
+{
+    mm_statpage_t *page;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+	return NULL;
+    page = mmap(NULL, sizeof(mm_statpage_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return page == MAP_FAILED ? NULL : page;
+}
+
+int mm_statpage_read(const mm_statpage_t *page, mm_statpage_t *copy)
+{
+    unsigned int s1, s2;
+    long tries;
+
+    for (tries = 0; tries < READ_TRIES; tries++) {
+	if ((s1 = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1)
+	    continue;
+	memcpy(copy, page, sizeof(*copy));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	s2 = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	if (s1 == s2)
+	    return 0;
+    }
+    return -1;
+}
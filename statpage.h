@@ -0,0 +1,73 @@
+/*
+ * statpage.h - A page of allocator statistics in POSIX shared memory,
+ *     for monitors to read without stopping or calling into the
+ *     process
+ *
+ * With mm_config "stats=<name>", mm.c keeps the counters below in the
+ * shared memory object /<name>. It counts every malloc, free, realloc
+ * and memalign privately and adds the counts to the page in batches,
+ * so the page may lag by a few dozen operations. The page is a
+ * seqlock: the writer makes seq odd, updates the counters, and makes
+ * seq even again, so a reader that sees the same even seq before and
+ * after copying the page has a consistent snapshot. Updates are made
+ * under the heap lock, so there is one writer at a time. The mmstat
+ * tool samples a page.
+ */
+#ifndef STATPAGE_H
+#define STATPAGE_H
+
+#include "sizeclass.h"
+
+#define MM_STATPAGE_MAGIC 0x6d6d7374  /* "mmst" */
+#define MM_STAT_CLASSES (MM_NUM_CLASSES + 1)  /* the last is for larger requests */
+
+typedef struct {
+    unsigned int magic;       /* MM_STATPAGE_MAGIC once the page is set up */
+    unsigned int classes;     /* entries of the class arrays */
+    int pid;                  /* the process that writes the page */
+    unsigned int seq;         /* odd while the counters are being updated */
+    unsigned long long mallocs;    /* mallocs, callocs and memaligns */
+    unsigned long long frees;
+    unsigned long long reallocs;
+    unsigned long long live_bytes; /* bytes of the blocks handed out, headers included */
+    unsigned long long heap_bytes; /* bytes of heap, free or not */
+    unsigned long long lock_waits; /* calls that found the heap lock taken */
+    unsigned long long class_mallocs[MM_STAT_CLASSES]; /* mallocs by request size class */
+    unsigned int class_size[MM_STAT_CLASSES];  /* largest request of each class, 0 for none */
+} mm_statpage_t;
+
+/*
+ * mm_statpage_open - Create (or take over) the object /name, map it
+ *     and set up the page. Returns NULL with errno set on failure.
+ */
+mm_statpage_t *mm_statpage_open(const char *name);
+
+/* mm_statpage_close - Unmap the page and remove its object */
+void mm_statpage_close(mm_statpage_t *page, const char *name);
+
+/*
+ * mm_statpage_attach - Map the page of /name read-only, for a reader.
+ *     Returns NULL with errno set if there is none.
+ */
+const mm_statpage_t *mm_statpage_attach(const char *name);
+
+/*
+ * mm_statpage_read - Copy a consistent snapshot of the page, retrying
+ *     while the writer is in the middle of an update. Returns -1 if
+ *     the page never settles, e.g. because the writer died mid-update.
+ */
+int mm_statpage_read(const mm_statpage_t *page, mm_statpage_t *copy);
+
+/* Bracket the writer's updates */
+static inline void mm_statpage_begin(mm_statpage_t *page)
+{
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void mm_statpage_end(mm_statpage_t *page)
+{
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* STATPAGE_H */
@@ -46,8 +46,12 @@ $summary = $opt_s;
 # requests. When a free request is encountered, the corresponding 
 # hash entry is deleted. When we are finished reading the trace,
 # what is left are the unmatched alloc/realloc requests.
+# calloc (c) and memalign (m) requests count as allocates, and sized
+# frees (F) as frees. SIZE remembers the current size of each block so
+# that sized frees can be checked against it.
 #
 %HASH = (); 
+%SIZE = ();
 
 # Read the trace header values
 $heap_size = <STDIN>;
@@ -78,6 +82,14 @@ while ($line = <STDIN>) {
 	next;
     }
 
+    # memalign requests carry the alignment before the size
+    if ($cmd eq "m") {
+	(undef, undef, $align, $size) = split(" ", $line);
+	if ($align & ($align - 1)) {
+	    die "$0: ERROR[$linenum]: alignment $align is not a power of two\n";
+	}
+    }
+
     # save the line for output later
     $lines[$requestnum++] = $line;
 
@@ -86,32 +98,46 @@ while ($line = <STDIN>) {
 	if (!$HASH{$id}) {
 	    die "$0: ERROR[$linenum]: realloc without previous alloc\n";
 	}
+	$SIZE{$id} = $size;
 	next;
     }
 
-    if ($cmd eq "a" and $HASH{$id} eq "a") {
+    $isalloc = ($cmd eq "a" or $cmd eq "c" or $cmd eq "m");
+    $isfree = ($cmd eq "f" or $cmd eq "F");
+
+    if (!$isalloc and !$isfree) {
+	die "$0: ERROR[$linenum]: unknown request type $cmd.\n";
+    }
+
+    if ($isalloc and $HASH{$id} and $HASH{$id} ne "f") {
 	die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
     }
 
-    if ($cmd eq "a" and $HASH{$id} eq "f") {
+    if ($isalloc and $HASH{$id} eq "f") {
 	die "$0: ERROR[$linenum]: reused ID $id.\n";
     }
 
-    if ($cmd eq "f" and !exists($HASH{$id})) {
+    if ($cmd eq "F" and exists($HASH{$id}) and $SIZE{$id} != $size) {
+	die "$0: ERROR[$linenum]: sized free of $size bytes, block has $SIZE{$id}.\n";
+    }
+
+    if ($isfree and !exists($HASH{$id})) {
 	die "$0: ERROR[$linenum]: freeing unallocated block.\n";
 	next;
     }
 
-    if ($cmd eq "f" and !$HASH{$id} eq "f") {
+    if ($isfree and !$HASH{$id} eq "f") {
 	die "$0: ERROR[$linenum]: freeing already freed block.\n";
 	next;
     }
     
-    if ($cmd eq "f") {
+    if ($isfree) {
 	delete $HASH{$id};
+	delete $SIZE{$id};
     }
     else {
 	$HASH{$id} = $cmd;
+	$SIZE{$id} = $size;
     }
 }
 
@@ -146,7 +172,8 @@ foreach $item (@lines) {
 
 # print a set of free requests that will balance the trace
 foreach $key (sort keys %HASH) {
-    if ($HASH{$key} ne "a" and $HASH{$key} ne "r") {
+    if ($HASH{$key} ne "a" and $HASH{$key} ne "r" and 
+	$HASH{$key} ne "c" and $HASH{$key} ne "m") {
 	die "$0: ERROR: Invalid free request in residue.\n";
     }
     print "f $key\n";
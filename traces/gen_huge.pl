@@ -0,0 +1,32 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = "huge.rep";
+$block_size = 3 << 28;      # 768 MB
+$small_size = 1 << 29;      # 512 MB, reallocated to ...
+$grown_size = 5 << 27;      # ... 640 MB
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Two 768 MB blocks and one grown from 512 MB to 640 MB: the live set
+# peaks at 2176 MB, past 2^31, and so do the heap offsets of the last
+# block. Needs a driver built with a MAX_HEAP of at least 4 GB.
+$suggested_heap_size = 2*$block_size + $grown_size;
+$num_blocks = 3;
+$num_ops = 7;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+print OUTFILE "a 0 $block_size\n";
+print OUTFILE "a 1 $block_size\n";
+print OUTFILE "a 2 $small_size\n";
+print OUTFILE "r 2 $grown_size\n";
+print OUTFILE "f 0\n";
+print OUTFILE "f 1\n";
+print OUTFILE "f 2\n";
+
+close OUTFILE;
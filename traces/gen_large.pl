@@ -0,0 +1,38 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = "large.rep";
+$large_size = 1 << 20;
+$size_increment = 4096;
+$small_size = 64;
+$num_iters = 4500;
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters. Each iteration allocates a ~1 MB block,
+# frees it again and keeps a small block, so the live set stays small
+# while the cumulative allocation passes 4 GB.
+$suggested_heap_size = $large_size + 7*$size_increment + $num_iters*$small_size + 100;
+$num_blocks = 2*$num_iters;
+$num_ops = 4*$num_iters;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+for ($i = 0;  $i < $num_iters; $i += 1) {
+    $seq1 = 2*$i;
+    $seq2 = 2*$i + 1;
+    $size = $large_size + ($i % 7)*$size_increment;
+    print OUTFILE "a $seq1 $size\n";
+    print OUTFILE "f $seq1\n";
+    print OUTFILE "a $seq2 $small_size\n";
+}
+for ($i = 0;  $i < $num_iters; $i += 1) {
+    $fseq = 2*$i + 1;
+    print OUTFILE "f $fseq\n";
+}
+
+close OUTFILE;